@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "CorpusGenerator.h"
+#include <algorithm>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <string>
+#include <system_error>
+
+namespace jakt_bindgen::bench {
+
+static constexpr char const* s_ak_header_name = "AKStubs.h";
+
+static constexpr char const* s_ak_header = R"~~~(#pragma once
+
+namespace AK {
+
+class StringView {
+public:
+    StringView(char const*);
+};
+
+class DeprecatedString {
+public:
+    DeprecatedString(StringView);
+};
+
+class Error { };
+
+template<typename T, typename E = Error>
+class ErrorOr {
+public:
+    ErrorOr(T);
+    ErrorOr(E);
+};
+
+template<typename T>
+class NonnullRefPtr { };
+
+template<typename T>
+class Optional { };
+
+template<typename>
+class Function;
+
+template<typename Out, typename... In>
+class Function<Out(In...)> { };
+
+class RefCountedBase { };
+
+template<typename T>
+class RefCounted : public RefCountedBase { };
+
+}
+
+using AK::DeprecatedString;
+using AK::Error;
+using AK::ErrorOr;
+using AK::Function;
+using AK::NonnullRefPtr;
+using AK::Optional;
+using AK::RefCounted;
+using AK::StringView;
+)~~~";
+
+static std::string headerName(unsigned header_index)
+{
+    return "Header" + std::to_string(header_index) + ".h";
+}
+
+static std::string className(unsigned header_index, unsigned class_index)
+{
+    return "Class" + std::to_string(header_index) + "_" + std::to_string(class_index);
+}
+
+static void writeMethod(llvm::raw_ostream& os, std::string const& class_name, unsigned method_index)
+{
+    // Cycle through the shapes the generator has to rewrite, so every header exercises all of them.
+    os << "    ";
+    switch (method_index % 6) {
+    case 0:
+        os << "ErrorOr<int> method" << method_index << "(int value, StringView name);\n";
+        break;
+    case 1:
+        os << "NonnullRefPtr<" << class_name << "> method" << method_index << "();\n";
+        break;
+    case 2:
+        os << "Optional<int> method" << method_index << "(bool flag) const;\n";
+        break;
+    case 3:
+        os << "void method" << method_index << "(Function<void(int, StringView)> callback);\n";
+        break;
+    case 4:
+        os << "DeprecatedString method" << method_index << "(Optional<DeprecatedString> const& text) const;\n";
+        break;
+    case 5:
+        os << "static ErrorOr<NonnullRefPtr<" << class_name << ">> method" << method_index << "(unsigned count);\n";
+        break;
+    }
+}
+
+static bool writeFile(std::filesystem::path const& path, std::string const& contents)
+{
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path.string(), ec, llvm::sys::fs::CD_CreateAlways);
+    if (ec) {
+        llvm::errs() << "Can't open file " << path.string() << ": " << ec.message() << "\n";
+        return false;
+    }
+    os << contents;
+    return true;
+}
+
+std::optional<std::vector<std::string>> generateCorpus(CorpusOptions const& options)
+{
+    if (auto ec = llvm::sys::fs::create_directories(options.directory.string())) {
+        llvm::errs() << "Can't create directory " << options.directory.string() << ": " << ec.message() << "\n";
+        return {};
+    }
+
+    if (!writeFile(options.directory / s_ak_header_name, s_ak_header))
+        return {};
+
+    std::vector<std::string> headers;
+    for (unsigned header_index = 0; header_index < options.headers; ++header_index) {
+        std::string contents;
+        llvm::raw_string_ostream os(contents);
+
+        os << "#pragma once\n\n";
+        os << "#include \"" << s_ak_header_name << "\"\n";
+        if (header_index > 0 && options.base_depth > 0)
+            os << "#include \"" << headerName(header_index - 1) << "\"\n";
+        os << "\nnamespace " << options.target_namespace << " {\n";
+
+        for (unsigned class_index = 0; class_index < options.classes_per_header; ++class_index) {
+            auto class_name = className(header_index, class_index);
+
+            std::string base_name;
+            if (class_index > 0 && class_index < options.base_depth)
+                base_name = className(header_index, class_index - 1);
+            else if (class_index == 0 && header_index > 0 && options.base_depth > 0 && options.classes_per_header > 0)
+                base_name = className(header_index - 1, std::min(options.base_depth, options.classes_per_header) - 1);
+            else
+                base_name = "RefCounted<" + class_name + ">";
+
+            os << "\nclass " << class_name << " : public " << base_name << " {\npublic:\n";
+            for (unsigned enum_index = 0; enum_index < options.nested_enums_per_class; ++enum_index)
+                os << "    enum class Kind" << enum_index << " {\n        First,\n        Second,\n        Third,\n    };\n\n";
+
+            os << "    " << class_name << "(int value);\n";
+            for (unsigned method_index = 0; method_index < options.methods_per_class; ++method_index)
+                writeMethod(os, class_name, method_index);
+
+            os << "\nprivate:\n    int m_value { 0 };\n};\n";
+        }
+
+        os << "\n}\n";
+
+        auto path = options.directory / headerName(header_index);
+        if (!writeFile(path, os.str()))
+            return {};
+        headers.push_back(std::filesystem::absolute(path).string());
+    }
+
+    return headers;
+}
+
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen::bench {
+
+struct CorpusOptions {
+    std::filesystem::path directory;
+    std::string target_namespace { "Bench" };
+
+    unsigned headers { 16 };
+    unsigned classes_per_header { 8 };
+    unsigned methods_per_class { 16 };
+    unsigned nested_enums_per_class { 2 };
+
+    // Length of the inheritance chain at the start of each header. The first class of a chain derives from the
+    // last class of the previous header (so that it has to be imported), or from RefCounted in the first header.
+    unsigned base_depth { 2 };
+};
+
+// Writes a minimal stand-in for the AK templates the generator knows about, followed by the synthetic headers.
+// Returns the absolute paths of the headers to bind, or nothing if any file couldn't be written.
+std::optional<std::vector<std::string>> generateCorpus(CorpusOptions const& options);
+
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ApiModelBuilder.h"
+#include "CXXClassListener.h"
+#include "CorpusGenerator.h"
+#include "JaktGenerator.h"
+#include "MemoryUsage.h"
+#include "TypeMap.h"
+
+#include <clang/AST/ASTConsumer.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/Tooling.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+
+static llvm::cl::opt<unsigned> s_headers("headers", llvm::cl::desc("Number of synthetic headers to generate"),
+    llvm::cl::init(16));
+
+static llvm::cl::opt<unsigned> s_classes("classes", llvm::cl::desc("Number of classes per header"),
+    llvm::cl::init(8));
+
+static llvm::cl::opt<unsigned> s_methods("methods", llvm::cl::desc("Number of methods per class"),
+    llvm::cl::init(16));
+
+static llvm::cl::opt<unsigned> s_enums("enums", llvm::cl::desc("Number of nested enums per class"),
+    llvm::cl::init(2));
+
+static llvm::cl::opt<unsigned> s_bases("bases", llvm::cl::desc("Length of the inheritance chain at the start of each header"),
+    llvm::cl::init(2));
+
+static llvm::cl::opt<unsigned> s_iterations("iterations", llvm::cl::desc("Number of times to process the whole corpus"),
+    llvm::cl::init(1));
+
+static llvm::cl::opt<std::string> s_corpus_dir("corpus-dir", llvm::cl::desc("Directory to generate the corpus in. A temporary directory is used (and removed) when not given"),
+    llvm::cl::value_desc("directory"));
+
+namespace {
+
+class Phase {
+public:
+    explicit Phase(char const* name)
+        : m_name(name)
+    {
+    }
+
+    void begin()
+    {
+        m_heap_at_begin = llvm::sys::Process::GetMallocUsage();
+        m_started = std::chrono::steady_clock::now();
+    }
+
+    void end()
+    {
+        m_wall_time += std::chrono::steady_clock::now() - m_started;
+        auto heap = llvm::sys::Process::GetMallocUsage();
+        if (heap > m_heap_at_begin)
+            m_max_heap_growth = std::max(m_max_heap_growth, heap - m_heap_at_begin);
+        // The high-water mark of the whole process, so it only ever grows from one phase to the next.
+        m_peak_rss = std::max(m_peak_rss, jakt_bindgen::peakResidentSetSize());
+    }
+
+    char const* name() const { return m_name; }
+    double milliseconds() const { return std::chrono::duration<double, std::milli>(m_wall_time).count(); }
+    size_t max_heap_growth() const { return m_max_heap_growth; }
+    size_t peak_rss() const { return m_peak_rss; }
+
+private:
+    char const* m_name;
+    std::chrono::steady_clock::time_point m_started;
+    std::chrono::steady_clock::duration m_wall_time {};
+    size_t m_heap_at_begin { 0 };
+    size_t m_max_heap_growth { 0 };
+    size_t m_peak_rss { 0 };
+};
+
+// Stops the parse phase once Sema is done with the translation unit, and times the listener's collection separately.
+class TimedConsumer : public clang::ASTConsumer {
+public:
+    TimedConsumer(std::unique_ptr<clang::ASTConsumer> collector, Phase& parse, Phase& collect)
+        : m_collector(std::move(collector))
+        , m_parse(parse)
+        , m_collect(collect)
+    {
+    }
+
+    virtual bool HandleTopLevelDecl(clang::DeclGroupRef group) override
+    {
+        return m_collector->HandleTopLevelDecl(group);
+    }
+
+    virtual void HandleTranslationUnit(clang::ASTContext& context) override
+    {
+        m_parse.end();
+        m_collect.begin();
+        m_collector->HandleTranslationUnit(context);
+        m_collect.end();
+    }
+
+private:
+    std::unique_ptr<clang::ASTConsumer> m_collector;
+    Phase& m_parse;
+    Phase& m_collect;
+};
+
+// Does what SourceFileHandler does, minus the file system output, with every phase measured on its own.
+class BenchHandler : public clang::tooling::SourceFileCallbacks {
+public:
+    explicit BenchHandler(std::string namespace_)
+        : m_listener(std::move(namespace_))
+    {
+    }
+
+    std::unique_ptr<clang::ASTConsumer> newASTConsumer()
+    {
+        return std::make_unique<TimedConsumer>(m_listener.newASTConsumer(), m_parse, m_collect);
+    }
+
+    virtual bool handleBeginSource(clang::CompilerInstance& CI) override
+    {
+        auto& source_manager = CI.getSourceManager();
+        m_ci = &CI;
+        m_main_file = source_manager.getFileEntryForID(source_manager.getMainFileID());
+
+        m_listener.resetForNextFile();
+        m_listener.setBoundFiles({ m_main_file });
+
+        m_parse.begin();
+        return true;
+    }
+
+    virtual void handleEndSource() override
+    {
+        m_emit.begin();
+
+        std::string contents;
+        llvm::raw_string_ostream os(contents);
+        if (!m_listener.tag_decls(m_main_file).empty()) {
+            auto model = jakt_bindgen::ApiModelBuilder(m_listener, m_ci->getASTContext()).build(m_main_file, m_main_file->getName().str());
+            jakt_bindgen::JaktGenerator(os, model, *m_type_map).generate();
+        }
+
+        m_emit.end();
+
+        // The AST goes away right after this.
+        m_listener.resetForNextFile();
+
+        m_bytes_emitted += contents.size();
+        ++m_headers_processed;
+    }
+
+    Phase const& parse() const { return m_parse; }
+    Phase const& collect() const { return m_collect; }
+    Phase const& emit() const { return m_emit; }
+    size_t bytes_emitted() const { return m_bytes_emitted; }
+    size_t headers_processed() const { return m_headers_processed; }
+
+private:
+    jakt_bindgen::CXXClassListener m_listener;
+    std::unique_ptr<jakt_bindgen::TypeMap> m_type_map { jakt_bindgen::TypeMap::createDefault() };
+    clang::CompilerInstance* m_ci { nullptr };
+    clang::FileEntry const* m_main_file { nullptr };
+
+    Phase m_parse { "parse" };
+    Phase m_collect { "collect" };
+    Phase m_emit { "emit" };
+    size_t m_bytes_emitted { 0 };
+    size_t m_headers_processed { 0 };
+};
+
+void printPhase(Phase const& phase, size_t headers)
+{
+    constexpr double mebibyte = 1024.0 * 1024.0;
+    llvm::outs() << llvm::format("%-10s %12.2f %16.3f %18.2f %15.2f\n",
+        phase.name(),
+        phase.milliseconds(),
+        headers ? phase.milliseconds() / headers : 0.0,
+        phase.max_heap_growth() / mebibyte,
+        phase.peak_rss() / mebibyte);
+}
+
+}
+
+int main(int argc, char const** argv)
+{
+    llvm::cl::ParseCommandLineOptions(argc, argv, "Measures jakt-bindgen on a synthetic header corpus\n");
+
+    jakt_bindgen::bench::CorpusOptions corpus {
+        .directory = s_corpus_dir.getValue(),
+        .headers = s_headers,
+        .classes_per_header = s_classes,
+        .methods_per_class = s_methods,
+        .nested_enums_per_class = s_enums,
+        .base_depth = s_bases,
+    };
+
+    bool remove_corpus = false;
+    if (corpus.directory.empty()) {
+        llvm::SmallString<128> temporary_directory;
+        if (auto ec = llvm::sys::fs::createUniqueDirectory("jakt-bindgen-bench", temporary_directory)) {
+            llvm::errs() << "Can't create temporary directory: " << ec.message() << "\n";
+            return 1;
+        }
+        corpus.directory = temporary_directory.str().str();
+        remove_corpus = true;
+    }
+
+    auto headers = jakt_bindgen::bench::generateCorpus(corpus);
+    if (!headers.has_value())
+        return 1;
+
+    auto corpus_directory = std::filesystem::absolute(corpus.directory).string();
+    clang::tooling::FixedCompilationDatabase compilations(corpus_directory, { "-xc++", "-std=c++20", "-Wno-pragma-once-outside-header", "-I" + corpus_directory });
+
+    BenchHandler handler(corpus.target_namespace);
+    auto action = clang::tooling::newFrontendActionFactory(&handler, &handler);
+
+    int result = 0;
+    for (unsigned i = 0; i < s_iterations && result == 0; ++i) {
+        clang::tooling::ClangTool tool(compilations, headers.value());
+        result = tool.run(action.get());
+    }
+
+    if (remove_corpus)
+        llvm::sys::fs::remove_directories(corpus.directory.string());
+
+    if (result != 0) {
+        llvm::errs() << "Failed to process the corpus\n";
+        return result;
+    }
+
+    llvm::outs() << "Corpus: " << corpus.headers << " headers, " << corpus.classes_per_header << " classes per header, "
+                 << corpus.methods_per_class << " methods per class, " << corpus.nested_enums_per_class << " enums per class, "
+                 << "base depth " << corpus.base_depth << "\n";
+    llvm::outs() << "Processed " << handler.headers_processed() << " headers in " << s_iterations << " iteration(s), "
+                 << handler.bytes_emitted() << " bytes of bindings\n\n";
+
+    llvm::outs() << llvm::format("%-10s %12s %16s %18s %15s\n", "phase", "wall (ms)", "per header (ms)", "heap growth (MiB)", "peak RSS (MiB)");
+    printPhase(handler.parse(), handler.headers_processed());
+    printPhase(handler.collect(), handler.headers_processed());
+    printPhase(handler.emit(), handler.headers_processed());
+
+    return 0;
+}
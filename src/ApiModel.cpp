@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ApiModel.h"
+#include "Console.h"
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <system_error>
+
+namespace jakt_bindgen {
+
+// Bump whenever the meaning of a field changes, so stale models are rejected instead of generating wrong bindings.
+static constexpr int64_t s_model_version = 3;
+
+static constexpr char const* s_type_kind_names[] = {
+    "builtin",
+    "record",
+    "enum",
+    "template",
+    "reference",
+    "pointer",
+    "function",
+    "unsupported",
+};
+
+static constexpr char const* s_method_kind_names[] = {
+    "regular",
+    "returns-reference",
+    "template",
+};
+
+template<typename Enum, size_t N>
+static std::optional<Enum> enumFromName(char const* const (&names)[N], llvm::StringRef name)
+{
+    for (size_t i = 0; i < N; ++i) {
+        if (name == names[i])
+            return static_cast<Enum>(i);
+    }
+    return {};
+}
+
+static llvm::json::Array serializeParameters(std::vector<ApiParameter> const& parameters)
+{
+    llvm::json::Array array;
+    for (auto const& parameter : parameters)
+        array.push_back(llvm::json::Object { { "name", parameter.name }, { "type", parameter.type } });
+    return array;
+}
+
+static llvm::json::Object serializeClass(ApiClass const& klass);
+
+static llvm::json::Array serializeTags(std::vector<ApiTag> const& tags)
+{
+    llvm::json::Array array;
+    for (auto const& tag : tags) {
+        if (tag.class_.has_value()) {
+            array.push_back(serializeClass(*tag.class_));
+            continue;
+        }
+
+        auto const& enumeration = *tag.enum_;
+        llvm::json::Array enumerators;
+        for (auto const& enumerator : enumeration.enumerators)
+            enumerators.push_back(llvm::json::Object { { "name", enumerator.name }, { "value", enumerator.value } });
+
+        llvm::json::Object object {
+            { "kind", "enum" },
+            { "name", enumeration.name },
+            { "enumerators", std::move(enumerators) },
+        };
+        if (enumeration.underlying_type.has_value())
+            object["underlying_type"] = *enumeration.underlying_type;
+        array.push_back(std::move(object));
+    }
+    return array;
+}
+
+static llvm::json::Object serializeClass(ApiClass const& klass)
+{
+    llvm::json::Array methods;
+    for (auto const& method : klass.methods) {
+        llvm::json::Object object {
+            { "kind", s_method_kind_names[static_cast<size_t>(method.kind)] },
+            { "name", method.name },
+            { "constructor", method.is_constructor },
+            { "static", method.is_static },
+            { "virtual", method.is_virtual },
+            { "protected", method.is_protected },
+            { "const", method.is_const },
+            { "parameters", serializeParameters(method.parameters) },
+        };
+        // Only regular methods are given a return type, the index of any other kind means nothing.
+        if (method.kind == ApiMethod::Kind::Regular)
+            object["return_type"] = method.return_type;
+        methods.push_back(std::move(object));
+    }
+
+    llvm::json::Array factories;
+    for (auto const& factory : klass.factories)
+        factories.push_back(serializeParameters(factory));
+
+    return llvm::json::Object {
+        { "kind", "class" },
+        { "name", klass.name },
+        { "ref_counted", klass.is_ref_counted },
+        { "core_object", klass.is_core_object },
+        { "factories", std::move(factories) },
+        { "bases", klass.bases },
+        { "methods", std::move(methods) },
+        { "nested_tags", serializeTags(klass.nested_tags) },
+    };
+}
+
+void ApiHeader::write(llvm::raw_ostream& os) const
+{
+    llvm::json::Array json_imports;
+    for (auto const& import : imports)
+        json_imports.push_back(llvm::json::Object { { "namespace", import.namespace_name }, { "name", import.name } });
+
+    llvm::json::Array json_types;
+    for (auto const& type : types) {
+        json_types.push_back(llvm::json::Object {
+            { "kind", s_type_kind_names[static_cast<size_t>(type.kind)] },
+            { "const", type.is_const },
+            { "name", type.name },
+            { "spelling", type.spelling },
+            { "children", type.children },
+        });
+    }
+
+    os << llvm::json::Value(llvm::json::Object {
+        { "version", s_model_version },
+        { "header", header_path },
+        { "namespace", namespace_name },
+        { "imports", std::move(json_imports) },
+        { "types", std::move(json_types) },
+        { "tags", serializeTags(tags) },
+        { "referenced_types", referenced_types },
+    });
+}
+
+bool ApiHeader::write(std::string const& path) const
+{
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::CD_CreateAlways);
+    if (ec) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Can't write API model " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    write(os);
+    return true;
+}
+
+// Reading is strict: a model that doesn't have exactly the shape written above is rejected as a whole.
+namespace {
+
+class ModelReader {
+public:
+    bool readHeader(llvm::json::Object const& root, ApiHeader& header)
+    {
+        if (root.getInteger("version") != s_model_version)
+            return fail("unsupported version");
+        if (!readString(root, "header", header.header_path) || !readString(root, "namespace", header.namespace_name))
+            return false;
+
+        auto const* types = root.getArray("types");
+        auto const* imports = root.getArray("imports");
+        auto const* tags = root.getArray("tags");
+        if (!types || !imports || !tags)
+            return fail("missing types, imports or tags");
+
+        m_type_count = types->size();
+        for (auto const& value : *types) {
+            auto const* object = value.getAsObject();
+            ApiType type;
+            llvm::StringRef kind;
+            if (!object || !readString(*object, "kind", kind) || !readBool(*object, "const", type.is_const)
+                || !readString(*object, "name", type.name) || !readString(*object, "spelling", type.spelling)
+                || !readTypeIndices(*object, "children", type.children, /* allow_non_type = */ true))
+                return fail("malformed type");
+            auto type_kind = enumFromName<ApiType::Kind>(s_type_kind_names, kind);
+            if (!type_kind.has_value())
+                return fail("unknown type kind");
+            type.kind = *type_kind;
+            if (!hasValidChildren(type, static_cast<ApiTypeIndex>(header.types.size())))
+                return fail(("malformed children of " + kind + " type " + type.spelling).str());
+            header.types.push_back(std::move(type));
+        }
+
+        for (auto const& value : *imports) {
+            auto const* object = value.getAsObject();
+            ApiImport import;
+            if (!object || !readString(*object, "namespace", import.namespace_name) || !readString(*object, "name", import.name))
+                return fail("malformed import");
+            header.imports.push_back(std::move(import));
+        }
+
+        auto const* referenced_types = root.getArray("referenced_types");
+        if (!referenced_types)
+            return fail("missing referenced_types");
+        for (auto const& value : *referenced_types) {
+            auto referenced_type = value.getAsString();
+            if (!referenced_type)
+                return fail("malformed referenced type");
+            header.referenced_types.push_back(referenced_type->str());
+        }
+
+        return readTags(*tags, header.tags);
+    }
+
+    std::string const& error() const { return m_error; }
+
+private:
+    bool fail(llvm::StringRef error)
+    {
+        if (m_error.empty())
+            m_error = error.str();
+        return false;
+    }
+
+    // The generator relies on the number of children of each kind, and on children coming before the types that
+    // refer to them (as ApiModelBuilder writes them), so that following children always ends.
+    static bool hasValidChildren(ApiType const& type, ApiTypeIndex own_index)
+    {
+        for (auto child : type.children) {
+            if (child == ApiType::non_type_argument ? type.kind != ApiType::Kind::Template : child >= own_index)
+                return false;
+        }
+
+        switch (type.kind) {
+        case ApiType::Kind::Reference:
+        case ApiType::Kind::Pointer:
+            return type.children.size() == 1;
+        case ApiType::Kind::Function:
+            return !type.children.empty();
+        case ApiType::Kind::Template:
+            return true;
+        case ApiType::Kind::Builtin:
+        case ApiType::Kind::Record:
+        case ApiType::Kind::Enum:
+        case ApiType::Kind::Unsupported:
+            return type.children.empty();
+        }
+        return false;
+    }
+
+    bool readString(llvm::json::Object const& object, llvm::StringRef key, llvm::StringRef& out)
+    {
+        auto value = object.getString(key);
+        if (!value)
+            return fail(("missing " + key).str());
+        out = *value;
+        return true;
+    }
+
+    bool readString(llvm::json::Object const& object, llvm::StringRef key, std::string& out)
+    {
+        llvm::StringRef value;
+        if (!readString(object, key, value))
+            return false;
+        out = value.str();
+        return true;
+    }
+
+    bool readBool(llvm::json::Object const& object, llvm::StringRef key, bool& out)
+    {
+        auto value = object.getBoolean(key);
+        if (!value)
+            return fail(("missing " + key).str());
+        out = *value;
+        return true;
+    }
+
+    bool readTypeIndex(llvm::json::Value const& value, ApiTypeIndex& out, bool allow_non_type = false)
+    {
+        auto index = value.getAsInteger();
+        if (!index)
+            return fail("malformed type index");
+        if (allow_non_type && *index == ApiType::non_type_argument) {
+            out = ApiType::non_type_argument;
+            return true;
+        }
+        if (*index < 0 || static_cast<size_t>(*index) >= m_type_count)
+            return fail("type index out of range");
+        out = static_cast<ApiTypeIndex>(*index);
+        return true;
+    }
+
+    bool readTypeIndices(llvm::json::Object const& object, llvm::StringRef key, std::vector<ApiTypeIndex>& out, bool allow_non_type)
+    {
+        auto const* array = object.getArray(key);
+        if (!array)
+            return fail(("missing " + key).str());
+        for (auto const& value : *array) {
+            ApiTypeIndex index;
+            if (!readTypeIndex(value, index, allow_non_type))
+                return false;
+            out.push_back(index);
+        }
+        return true;
+    }
+
+    bool readParameters(llvm::json::Array const* array, std::vector<ApiParameter>& out)
+    {
+        if (!array)
+            return fail("missing parameters");
+        for (auto const& value : *array) {
+            auto const* object = value.getAsObject();
+            ApiParameter parameter;
+            if (!object || !readString(*object, "name", parameter.name) || !object->get("type") || !readTypeIndex(*object->get("type"), parameter.type))
+                return fail("malformed parameter");
+            out.push_back(std::move(parameter));
+        }
+        return true;
+    }
+
+    bool readTags(llvm::json::Array const& array, std::vector<ApiTag>& out)
+    {
+        for (auto const& value : array) {
+            auto const* object = value.getAsObject();
+            llvm::StringRef kind;
+            if (!object || !readString(*object, "kind", kind))
+                return fail("malformed tag");
+
+            ApiTag tag;
+            if (kind == "class") {
+                if (!readClass(*object, tag.class_.emplace()))
+                    return false;
+            } else if (kind == "enum") {
+                if (!readEnum(*object, tag.enum_.emplace()))
+                    return false;
+            } else {
+                return fail("unknown tag kind");
+            }
+            out.push_back(std::move(tag));
+        }
+        return true;
+    }
+
+    bool readEnum(llvm::json::Object const& object, ApiEnum& enumeration)
+    {
+        if (!readString(object, "name", enumeration.name))
+            return false;
+        if (auto const* underlying_type = object.get("underlying_type")) {
+            if (!readTypeIndex(*underlying_type, enumeration.underlying_type.emplace()))
+                return false;
+        }
+
+        auto const* enumerators = object.getArray("enumerators");
+        if (!enumerators)
+            return fail("missing enumerators");
+        for (auto const& value : *enumerators) {
+            auto const* fields = value.getAsObject();
+            ApiEnumerator enumerator;
+            if (!fields || !readString(*fields, "name", enumerator.name) || !readString(*fields, "value", enumerator.value))
+                return fail("malformed enumerator");
+            enumeration.enumerators.push_back(std::move(enumerator));
+        }
+        return true;
+    }
+
+    bool readClass(llvm::json::Object const& object, ApiClass& klass)
+    {
+        if (!readString(object, "name", klass.name) || !readBool(object, "ref_counted", klass.is_ref_counted)
+            || !readBool(object, "core_object", klass.is_core_object))
+            return false;
+
+        auto const* factories = object.getArray("factories");
+        auto const* bases = object.getArray("bases");
+        auto const* methods = object.getArray("methods");
+        auto const* nested_tags = object.getArray("nested_tags");
+        if (!factories || !bases || !methods || !nested_tags)
+            return fail("malformed class");
+
+        for (auto const& value : *factories) {
+            if (!readParameters(value.getAsArray(), klass.factories.emplace_back()))
+                return false;
+        }
+
+        for (auto const& value : *bases) {
+            auto base = value.getAsString();
+            if (!base)
+                return fail("malformed base");
+            klass.bases.push_back(base->str());
+        }
+
+        for (auto const& value : *methods) {
+            auto const* fields = value.getAsObject();
+            ApiMethod method;
+            llvm::StringRef kind;
+            if (!fields || !readString(*fields, "kind", kind) || !readString(*fields, "name", method.name)
+                || !readBool(*fields, "constructor", method.is_constructor) || !readBool(*fields, "static", method.is_static)
+                || !readBool(*fields, "virtual", method.is_virtual) || !readBool(*fields, "protected", method.is_protected)
+                || !readBool(*fields, "const", method.is_const) || !readParameters(fields->getArray("parameters"), method.parameters))
+                return fail("malformed method");
+            auto method_kind = enumFromName<ApiMethod::Kind>(s_method_kind_names, kind);
+            if (!method_kind.has_value())
+                return fail("unknown method kind");
+            method.kind = *method_kind;
+            if (method.kind == ApiMethod::Kind::Regular) {
+                auto const* return_type = fields->get("return_type");
+                if (!return_type || !readTypeIndex(*return_type, method.return_type))
+                    return fail("malformed method");
+            }
+            klass.methods.push_back(std::move(method));
+        }
+
+        return readTags(*nested_tags, klass.nested_tags);
+    }
+
+    size_t m_type_count { 0 };
+    std::string m_error;
+};
+
+}
+
+std::optional<ApiHeader> ApiHeader::read(std::string const& path)
+{
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Can't read API model " << path << ": " << buffer.getError().message() << "\n";
+        return {};
+    }
+
+    auto json = llvm::json::parse(buffer.get()->getBuffer());
+    if (!json) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Malformed API model " << path << ": " << json.takeError() << "\n";
+        return {};
+    }
+
+    ApiHeader header;
+    ModelReader reader;
+    auto const* root = json->getAsObject();
+    if (!root || !reader.readHeader(*root, header)) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Malformed API model " << path << ": " << (reader.error().empty() ? "not an object" : reader.error()) << "\n";
+        return {};
+    }
+    return header;
+}
+
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+}
+
+namespace jakt_bindgen {
+
+// The API of one bound header, as extracted from Clang's AST, in a form that outlives the translation unit.
+// JaktGenerator only ever looks at this model, so bindings can be generated again from a serialized copy
+// (see --emit-api-model and --from-api-model) without running Clang at all.
+
+using ApiTypeIndex = uint32_t;
+
+// A C++ type as it appears in a signature, reduced to what the Jakt type mapping needs.
+// Types refer to each other by their index in ApiHeader::types, and each distinct type is only stored once.
+struct ApiType {
+    enum class Kind {
+        Builtin,
+        Record,
+        Enum,
+        // A class template specialization, e.g. AK::ErrorOr<int>.
+        Template,
+        Reference,
+        Pointer,
+        // A function type, as used in AK::Function<void(int)>.
+        Function,
+        // Anything else. It's an error to print a binding that uses one.
+        Unsupported,
+    };
+
+    // Marks a template argument that isn't a type.
+    static constexpr ApiTypeIndex non_type_argument = UINT32_MAX;
+
+    Kind kind { Kind::Unsupported };
+    bool is_const { false };
+
+    // Builtin: the C++ spelling of the builtin type, e.g. "unsigned long".
+    // Record, Enum and Template: the fully qualified name of the type or class template, e.g. "AK::ErrorOr".
+    std::string name;
+
+    // How the type is spelled in C++, without its local qualifiers.
+    std::string spelling;
+
+    // Template: the template arguments. Reference and Pointer: the pointee. Function: the return type, then the parameters.
+    std::vector<ApiTypeIndex> children;
+};
+
+struct ApiParameter {
+    std::string name;
+    ApiTypeIndex type { 0 };
+};
+
+struct ApiMethod {
+    enum class Kind {
+        Regular,
+        // Jakt can't bind these yet, so they're only mentioned in a comment.
+        ReturnsReference,
+        Template,
+    };
+
+    Kind kind { Kind::Regular };
+    std::string name;
+    bool is_constructor { false };
+    bool is_static { false };
+    bool is_virtual { false };
+    bool is_protected { false };
+    bool is_const { false };
+    std::vector<ApiParameter> parameters;
+    // Only set for regular methods.
+    ApiTypeIndex return_type { 0 };
+};
+
+struct ApiEnumerator {
+    std::string name;
+    std::string value;
+};
+
+struct ApiEnum {
+    std::string name;
+    std::optional<ApiTypeIndex> underlying_type;
+    std::vector<ApiEnumerator> enumerators;
+};
+
+struct ApiTag;
+
+struct ApiClass {
+    std::string name;
+
+    // Derives from AK::RefCountedBase, so it's bound as a class instead of a struct.
+    bool is_ref_counted { false };
+
+    // Derives from Core::Object, so it gets a fallible create() factory for each of its constructors.
+    bool is_core_object { false };
+    std::vector<std::vector<ApiParameter>> factories;
+
+    // Fully qualified names of the bases, including the ones that aren't bound, e.g. "AK::RefCounted".
+    std::vector<std::string> bases;
+    std::vector<ApiMethod> methods;
+    std::vector<ApiTag> nested_tags;
+};
+
+struct ApiTag {
+    // Exactly one of these is set.
+    std::optional<ApiClass> class_;
+    std::optional<ApiEnum> enum_;
+};
+
+struct ApiImport {
+    std::string namespace_name;
+    std::string name;
+};
+
+struct ApiHeader {
+    // The path the header is imported with, relative to the base directory.
+    std::string header_path;
+    std::string namespace_name;
+    std::vector<ApiImport> imports;
+    std::vector<ApiTag> tags;
+    std::vector<ApiType> types;
+
+    // Fully qualified names of the classes and enums used by the bases and signatures of the header's tags,
+    // in order of first use. A SymbolIndex turns them into imports.
+    std::vector<std::string> referenced_types;
+
+    // Serialized as JSON, with the type table shared by every signature in the header.
+    static std::optional<ApiHeader> read(std::string const& path);
+    bool write(std::string const& path) const;
+    void write(llvm::raw_ostream& os) const;
+};
+
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "ApiModelBuilder.h"
+#include "CXXClassListener.h"
+#include "KnownDecls.h"
+#include <cassert>
+#include <clang/AST/DeclTemplate.h>
+#include <clang/Basic/LangOptions.h>
+#include <clang/Basic/Specifiers.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/Casting.h>
+#include <llvm/Support/ErrorHandling.h>
+
+namespace jakt_bindgen {
+
+ApiModelBuilder::ApiModelBuilder(CXXClassListener const& class_information, clang::ASTContext const& context)
+    : m_class_information(class_information)
+    , m_known_decls(class_information.known_decls())
+    , m_context(context)
+    , m_printing_policy(clang::LangOptions {})
+{
+    // FIXME: Get the language options from higher up in the stack. The SourceFileHandler can probably get one from the clang::CompilerInstance
+    m_printing_policy.adjustForCPlusPlus();
+}
+
+ApiHeader ApiModelBuilder::build(clang::FileEntry const* header_file, std::string header_path)
+{
+    ApiHeader header;
+    header.header_path = std::move(header_path);
+
+    m_header = &header;
+    m_type_indices.clear();
+    m_referenced_types.clear();
+
+    for (auto const* klass : m_class_information.imports(header_file)) {
+        header.imports.push_back({
+            llvm::cast<clang::NamespaceDecl>(klass->getEnclosingNamespaceContext())->getQualifiedNameAsString(),
+            klass->getName().str(),
+        });
+    }
+
+    auto const& tag_decls = m_class_information.tag_decls(header_file);
+    if (!tag_decls.empty())
+        header.namespace_name = llvm::cast<clang::NamespaceDecl>(tag_decls[0]->getEnclosingNamespaceContext())->getQualifiedNameAsString();
+
+    for (clang::TagDecl const* tag_decl : tag_decls) {
+        if (auto tag = buildTag(tag_decl); tag.has_value())
+            header.tags.push_back(std::move(tag.value()));
+    }
+
+    m_header = nullptr;
+    return header;
+}
+
+std::optional<ApiTag> ApiModelBuilder::buildTag(clang::TagDecl const* tag_declaration)
+{
+    ApiTag tag;
+    if (auto const* klass = llvm::dyn_cast<clang::CXXRecordDecl>(tag_declaration)) {
+        // Skip incomplete types, i.e. forward declared in the header.
+        // Skip unions as well, as Jakt can't represent them.
+        if (!klass->isCompleteDefinition() || klass->isUnion())
+            return {};
+        tag.class_ = buildClass(klass);
+    } else {
+        assert(llvm::isa<clang::EnumDecl>(tag_declaration));
+        tag.enum_ = buildEnum(llvm::cast<clang::EnumDecl>(tag_declaration));
+    }
+    return tag;
+}
+
+ApiClass ApiModelBuilder::buildClass(clang::CXXRecordDecl const* class_definition)
+{
+    ApiClass klass;
+    klass.name = class_definition->getName().str();
+    klass.is_ref_counted = m_known_decls.derivesFrom(class_definition, KnownDecls::Record::RefCountedBase);
+
+    for (auto const& base : class_definition->bases()) {
+        if (base.isVirtual())
+            llvm::report_fatal_error("ERROR: Don't know how to handle virtual bases", false);
+        if (base.getAccessSpecifier() != clang::AccessSpecifier::AS_public)
+            llvm::report_fatal_error("ERROR: Don't know how to handle non-public bases", false);
+        clang::RecordType const* Ty = base.getType()->getAs<clang::RecordType>();
+        clang::CXXRecordDecl const* base_record = llvm::cast_or_null<clang::CXXRecordDecl>(Ty->getDecl()->getDefinition());
+        if (!base_record)
+            llvm::report_fatal_error("ERROR: Base class unusable", false);
+
+        // Bases like AK::RefCounted are left out by the generator, according to its TypeMap.
+        klass.bases.push_back(base_record->getQualifiedNameAsString());
+        addReferencedType(klass.bases.back());
+    }
+
+    if (m_class_information.contains_methods_for(class_definition)) {
+        for (auto const* method : m_class_information.methods_for(class_definition)) {
+            if (method->getAccess() == clang::AccessSpecifier::AS_private)
+                continue;
+            klass.methods.push_back(buildMethod(method));
+        }
+    }
+
+    // FIXME: When variadic generics are added to jakt, don't hardcode these special cases.
+    // Derived from Core::Object? Add [[name="try_create"]] <name> create() throws overload for each constructor
+    if (m_known_decls.derivesFrom(class_definition, KnownDecls::Record::CoreObject)) {
+        assert(klass.is_ref_counted);
+        klass.is_core_object = true;
+        for (clang::CXXConstructorDecl const* ctor : class_definition->ctors()) {
+            auto& factory = klass.factories.emplace_back();
+            if (!ctor->isDefaultConstructor() && !ctor->isCopyOrMoveConstructor() && !ctor->isDeleted())
+                factory = buildParameters(ctor->parameters());
+        }
+    }
+
+    for (clang::TagDecl const* tag_decl : m_class_information.nested_tags_for(class_definition)) {
+        if (auto tag = buildTag(tag_decl); tag.has_value())
+            klass.nested_tags.push_back(std::move(tag.value()));
+    }
+
+    return klass;
+}
+
+ApiMethod ApiModelBuilder::buildMethod(clang::CXXMethodDecl const* method)
+{
+    ApiMethod api_method;
+
+    if (method->getReturnType()->isReferenceType()) {
+        api_method.kind = ApiMethod::Kind::ReturnsReference;
+        api_method.name = method->getName().str();
+        return api_method;
+    }
+
+    if (method->getDescribedFunctionTemplate()) {
+        api_method.kind = ApiMethod::Kind::Template;
+        api_method.name = method->getQualifiedNameAsString();
+        return api_method;
+    }
+
+    api_method.name = method->getDeclName().getAsString();
+    api_method.is_constructor = llvm::isa<clang::CXXConstructorDecl>(method);
+    api_method.is_static = method->isStatic() || api_method.is_constructor;
+    api_method.is_virtual = method->isVirtual();
+    api_method.is_protected = method->getAccess() == clang::AccessSpecifier::AS_protected;
+    api_method.is_const = method->isConst();
+    assert(!(api_method.is_static && api_method.is_virtual));
+
+    api_method.parameters = buildParameters(method->parameters());
+    api_method.return_type = typeIndex(method->getReturnType());
+    addReferencedTypesOf(api_method.return_type);
+    return api_method;
+}
+
+std::vector<ApiParameter> ApiModelBuilder::buildParameters(llvm::ArrayRef<clang::ParmVarDecl*> parameters)
+{
+    std::vector<ApiParameter> result;
+    result.reserve(parameters.size());
+    for (clang::ParmVarDecl const* parameter : parameters) {
+        result.push_back({ parameter->getName().str(), typeIndex(parameter->getType()) });
+        addReferencedTypesOf(result.back().type);
+    }
+    return result;
+}
+
+ApiEnum ApiModelBuilder::buildEnum(clang::EnumDecl const* enum_definition)
+{
+    ApiEnum enumeration;
+    enumeration.name = enum_definition->getName().str();
+    if (enum_definition->isFixed())
+        enumeration.underlying_type = typeIndex(enum_definition->getIntegerType());
+    for (auto const* constant_decl : enum_definition->enumerators())
+        enumeration.enumerators.push_back({ constant_decl->getName().str(), llvm::toString(constant_decl->getInitVal(), 10) });
+    return enumeration;
+}
+
+ApiTypeIndex ApiModelBuilder::typeIndex(clang::QualType const& type)
+{
+    auto key = type.getCanonicalType();
+    if (auto it = m_type_indices.find(key); it != m_type_indices.end())
+        return it->second;
+
+    // Children are built first, so a type's index is always greater than those of the types it refers to.
+    auto api_type = buildType(type);
+    auto index = static_cast<ApiTypeIndex>(m_header->types.size());
+    m_header->types.push_back(std::move(api_type));
+    m_type_indices.try_emplace(key, index);
+    return index;
+}
+
+void ApiModelBuilder::addReferencedType(std::string const& qualified_name)
+{
+    if (m_referenced_types.insert(qualified_name).second)
+        m_header->referenced_types.push_back(qualified_name);
+}
+
+void ApiModelBuilder::addReferencedTypesOf(ApiTypeIndex type)
+{
+    if (type == ApiType::non_type_argument)
+        return;
+
+    // Template arguments, pointees and the types in function signatures all need to be in scope as well.
+    auto const& api_type = m_header->types[type];
+    if (api_type.kind == ApiType::Kind::Record || api_type.kind == ApiType::Kind::Enum)
+        addReferencedType(api_type.name);
+    for (auto child : api_type.children)
+        addReferencedTypesOf(child);
+}
+
+ApiType ApiModelBuilder::buildType(clang::QualType const& base_type)
+{
+    auto type = base_type.getDesugaredType(m_context);
+
+    ApiType api_type;
+    api_type.is_const = type.isConstQualified();
+    api_type.spelling = type.withoutLocalFastQualifiers().getAsString(m_printing_policy);
+
+    if (auto const* reference_type = type->getAs<clang::ReferenceType>()) {
+        api_type.kind = ApiType::Kind::Reference;
+        api_type.children.push_back(typeIndex(reference_type->getPointeeType()));
+    } else if (auto const* pointer_type = type->getAs<clang::PointerType>()) {
+        api_type.kind = ApiType::Kind::Pointer;
+        api_type.children.push_back(typeIndex(pointer_type->getPointeeType()));
+    } else if (auto const* builtin_type = type->getAs<clang::BuiltinType>()) {
+        api_type.kind = ApiType::Kind::Builtin;
+        api_type.name = builtin_type->getName(m_printing_policy).str();
+    } else if (auto const* record_type = type->getAs<clang::RecordType>()) {
+        if (auto const* specialization = llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(record_type->getDecl())) {
+            api_type.kind = ApiType::Kind::Template;
+            api_type.name = specialization->getQualifiedNameAsString();
+            for (auto const& argument : specialization->getTemplateArgs().asArray()) {
+                if (argument.getKind() == clang::TemplateArgument::Type)
+                    api_type.children.push_back(typeIndex(argument.getAsType()));
+                else
+                    api_type.children.push_back(ApiType::non_type_argument);
+            }
+        } else {
+            api_type.kind = ApiType::Kind::Record;
+            api_type.name = record_type->getDecl()->getQualifiedNameAsString();
+        }
+    } else if (auto const* enum_type = type->getAs<clang::EnumType>()) {
+        api_type.kind = ApiType::Kind::Enum;
+        api_type.name = enum_type->getDecl()->getQualifiedNameAsString();
+    } else if (auto const* function_type = type->getAs<clang::FunctionProtoType>()) {
+        api_type.kind = ApiType::Kind::Function;
+        api_type.children.push_back(typeIndex(function_type->getReturnType()));
+        for (auto const& parameter_type : function_type->param_types())
+            api_type.children.push_back(typeIndex(parameter_type));
+    } else {
+        api_type.kind = ApiType::Kind::Unsupported;
+    }
+
+    return api_type;
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "ApiModel.h"
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/PrettyPrinter.h>
+#include <clang/AST/Type.h>
+#include <clang/Basic/FileManager.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <optional>
+#include <string>
+
+namespace jakt_bindgen {
+
+class CXXClassListener;
+class KnownDecls;
+
+// Extracts the ApiHeader of a bound header from the declarations the listener collected.
+// Everything JaktGenerator needs to know about a declaration or type is decided here, while the AST is still alive.
+class ApiModelBuilder {
+public:
+    ApiModelBuilder(CXXClassListener const& class_information, clang::ASTContext const& context);
+
+    ApiHeader build(clang::FileEntry const* header, std::string header_path);
+
+private:
+    std::optional<ApiTag> buildTag(clang::TagDecl const* tag_declaration);
+    ApiClass buildClass(clang::CXXRecordDecl const* class_definition);
+    ApiEnum buildEnum(clang::EnumDecl const* enum_definition);
+    ApiMethod buildMethod(clang::CXXMethodDecl const* method);
+    std::vector<ApiParameter> buildParameters(llvm::ArrayRef<clang::ParmVarDecl*> parameters);
+
+    ApiTypeIndex typeIndex(clang::QualType const& type);
+    ApiType buildType(clang::QualType const& type);
+
+    void addReferencedType(std::string const& qualified_name);
+    void addReferencedTypesOf(ApiTypeIndex type);
+
+    CXXClassListener const& m_class_information;
+    KnownDecls const& m_known_decls;
+    clang::ASTContext const& m_context;
+    clang::PrintingPolicy m_printing_policy;
+
+    // Only valid during build(). Types are keyed on their canonical type, as every rule that maps them looks through sugar.
+    ApiHeader* m_header { nullptr };
+    llvm::DenseMap<clang::QualType, ApiTypeIndex> m_type_indices;
+    llvm::StringSet<> m_referenced_types;
+};
+
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "AstSnapshotCache.h"
+#include "BindingCache.h"
+#include "Console.h"
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/DiagnosticIDs.h>
+#include <clang/Basic/DiagnosticOptions.h>
+#include <clang/Basic/FileSystemOptions.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Basic/Version.h>
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <mutex>
+
+namespace jakt_bindgen {
+
+AstSnapshotCache::~AstSnapshotCache() = default;
+
+std::unique_ptr<AstSnapshotCache> AstSnapshotCache::open(std::filesystem::path directory)
+{
+    auto manifest = BindingCache::open(std::move(directory));
+    if (!manifest)
+        return nullptr;
+
+    auto cache = std::unique_ptr<AstSnapshotCache>(new AstSnapshotCache);
+    cache->m_manifest = std::move(manifest);
+    cache->m_pch_container_operations = std::make_shared<clang::PCHContainerOperations>();
+    return cache;
+}
+
+std::string AstSnapshotCache::computeKey(std::vector<clang::tooling::CompileCommand> const& commands, std::string const& pch_path)
+{
+    std::vector<std::string> inputs { "ast-snapshot", clang::getClangFullVersion(), pch_path };
+    for (auto const& command : commands) {
+        inputs.push_back(command.Directory);
+        inputs.insert(inputs.end(), command.CommandLine.begin(), command.CommandLine.end());
+    }
+    return BindingCache::computeKey(inputs);
+}
+
+std::filesystem::path AstSnapshotCache::snapshotPathFor(std::string const& source_path) const
+{
+    // One snapshot per header, replaced whenever the header needs to be parsed again.
+    return m_manifest->directory() / (std::filesystem::path(source_path).stem().string() + "-" + BindingCache::computeKey({ source_path }) + ".ast");
+}
+
+std::unique_ptr<clang::ASTUnit> AstSnapshotCache::load(std::string const& source_path, std::string const& key) const
+{
+    if (!m_manifest->isUpToDate(source_path, key))
+        return nullptr;
+
+    // A snapshot that fails to load (e.g. because the PCH it refers to was rebuilt) just means parsing the header again,
+    // so keep whatever the AST reader has to say about it to ourselves.
+    llvm::IntrusiveRefCntPtr<clang::DiagnosticsEngine> diagnostics(new clang::DiagnosticsEngine(
+        new clang::DiagnosticIDs, new clang::DiagnosticOptions, new clang::IgnoringDiagConsumer));
+
+    auto unit = clang::ASTUnit::LoadFromASTFile(snapshotPathFor(source_path).string(), m_pch_container_operations->getRawReader(),
+        clang::ASTUnit::LoadEverything, diagnostics, clang::FileSystemOptions {});
+    if (!unit) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Can't load AST snapshot of " << source_path << ", parsing it again\n";
+    }
+    return unit;
+}
+
+std::vector<std::string> AstSnapshotCache::dependencies(std::string const& source_path) const
+{
+    return m_manifest->dependencies(source_path);
+}
+
+void AstSnapshotCache::store(clang::ASTUnit& unit, std::string const& source_path, std::string key, std::vector<std::string> const& dependencies)
+{
+    auto snapshot_path = snapshotPathFor(source_path).string();
+    // ASTUnit::Save returns true on failure. It writes to a temporary file first, so a concurrent load never sees half a snapshot.
+    if (unit.Save(snapshot_path)) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Can't write AST snapshot of " << source_path << " to " << snapshot_path << "\n";
+        return;
+    }
+    m_manifest->update(source_path, std::move(key), std::move(snapshot_path), dependencies);
+}
+
+bool AstSnapshotCache::save() const
+{
+    return m_manifest->save();
+}
+
+std::vector<std::string> AstSnapshotCache::dependenciesOf(clang::ASTUnit const& unit)
+{
+    auto const& source_manager = unit.getSourceManager();
+    auto const& file_manager = unit.getFileManager();
+
+    std::vector<std::string> dependencies;
+    for (auto it = source_manager.fileinfo_begin(); it != source_manager.fileinfo_end(); ++it) {
+        llvm::SmallString<256> path(it->first->getName());
+        file_manager.makeAbsolutePath(path);
+        llvm::sys::path::remove_dots(path, /* remove_dot_dot */ true);
+        dependencies.emplace_back(path.str());
+    }
+    return dependencies;
+}
+
+}
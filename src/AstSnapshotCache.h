@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Serialization/PCHContainerOperations.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+class BindingCache;
+
+// Serialized ASTs of the headers parsed by earlier runs, keyed on their compile commands and the contents of their include closure.
+// Nothing jakt-bindgen specific goes into a snapshot, so runs with a different target namespace or different options can
+// load them instead of running the frontend over AK and LibCore again.
+class AstSnapshotCache {
+public:
+    static std::unique_ptr<AstSnapshotCache> open(std::filesystem::path directory);
+    ~AstSnapshotCache();
+
+    // Covers the clang version and the commands the header is compiled with. The PCH, if any, is referenced
+    // by the snapshot and has to be in the same place when it's loaded again.
+    static std::string computeKey(std::vector<clang::tooling::CompileCommand> const& commands, std::string const& pch_path);
+
+    // Returns null unless there's a snapshot for the header with the same key and unchanged dependencies.
+    std::unique_ptr<clang::ASTUnit> load(std::string const& source_path, std::string const& key) const;
+    std::vector<std::string> dependencies(std::string const& source_path) const;
+
+    void store(clang::ASTUnit& unit, std::string const& source_path, std::string key, std::vector<std::string> const& dependencies);
+
+    bool save() const;
+
+    // Absolute paths of every file the unit's source manager loaded, including its main file.
+    static std::vector<std::string> dependenciesOf(clang::ASTUnit const& unit);
+
+private:
+    AstSnapshotCache() = default;
+
+    std::filesystem::path snapshotPathFor(std::string const& source_path) const;
+
+    std::unique_ptr<BindingCache> m_manifest;
+    std::shared_ptr<clang::PCHContainerOperations> m_pch_container_operations;
+};
+
+}
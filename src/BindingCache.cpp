@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "BindingCache.h"
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <system_error>
+
+namespace jakt_bindgen {
+
+// Bump this whenever the layout of the manifest or of the cached models changes.
+// Version 1 cached models with their imports already resolved.
+static constexpr int64_t s_manifest_version = 2;
+
+// llvm::json returns llvm::Optional or std::optional depending on the LLVM version, so only use the common subset.
+static std::string getString(llvm::json::Object const& object, llvm::StringRef key)
+{
+    if (auto value = object.getString(key))
+        return value->str();
+    return {};
+}
+
+static int64_t getInteger(llvm::json::Object const& object, llvm::StringRef key)
+{
+    if (auto value = object.getInteger(key))
+        return *value;
+    return 0;
+}
+
+static std::optional<uint64_t> hashFileContents(llvm::StringRef path)
+{
+    auto buffer = llvm::MemoryBuffer::getFile(path, /* IsText */ false, /* RequiresNullTerminator */ false);
+    if (!buffer)
+        return {};
+    return llvm::xxHash64(buffer.get()->getBuffer());
+}
+
+std::optional<FileFingerprint> FileFingerprint::create(llvm::StringRef path)
+{
+    llvm::sys::fs::file_status status;
+    if (llvm::sys::fs::status(path, status))
+        return {};
+
+    auto hash = hashFileContents(path);
+    if (!hash.has_value())
+        return {};
+
+    return FileFingerprint {
+        .path = path.str(),
+        .size = status.getSize(),
+        .modification_time = status.getLastModificationTime().time_since_epoch().count(),
+        .content_hash = hash.value(),
+    };
+}
+
+FileFingerprint FileFingerprint::create(llvm::StringRef path, int64_t modification_time, llvm::StringRef contents)
+{
+    return FileFingerprint {
+        .path = path.str(),
+        .size = contents.size(),
+        .modification_time = modification_time,
+        .content_hash = llvm::xxHash64(contents),
+    };
+}
+
+bool FileFingerprint::matchesFileOnDisk() const
+{
+    llvm::sys::fs::file_status status;
+    if (llvm::sys::fs::status(path, status))
+        return false;
+    if (status.getSize() != size)
+        return false;
+    if (status.getLastModificationTime().time_since_epoch().count() == modification_time)
+        return true;
+
+    // Touched, but possibly not changed (e.g. a branch switch and back).
+    return hashFileContents(path) == content_hash;
+}
+
+BindingCache::BindingCache(std::filesystem::path directory)
+    : m_directory(std::move(directory))
+{
+}
+
+std::unique_ptr<BindingCache> BindingCache::open(std::filesystem::path directory)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        llvm::errs() << "Can't create cache directory " << directory.string() << ": " << ec.message() << "\n";
+        return nullptr;
+    }
+
+    auto cache = std::unique_ptr<BindingCache>(new BindingCache(std::move(directory)));
+    cache->load();
+    return cache;
+}
+
+std::string BindingCache::computeKey(llvm::ArrayRef<std::string> inputs)
+{
+    std::string key_material = JAKT_BINDGEN_VERSION;
+    for (auto const& input : inputs) {
+        // Separate inputs with a character that can't appear in a command line argument,
+        // so that {"ab", "c"} and {"a", "bc"} produce different keys.
+        key_material += '\0';
+        key_material += input;
+    }
+    return llvm::utohexstr(llvm::xxHash64(key_material));
+}
+
+bool BindingCache::isUpToDate(std::string const& source_path, std::string const& key) const
+{
+    Entry entry;
+    {
+        std::scoped_lock lock(m_lock);
+        auto it = m_entries.find(source_path);
+        if (it == m_entries.end())
+            return false;
+        entry = it->second;
+    }
+
+    if (entry.key != key)
+        return false;
+    if (!std::filesystem::exists(entry.output_path))
+        return false;
+
+    for (auto const& dependency : entry.dependencies) {
+        if (!dependency.matchesFileOnDisk())
+            return false;
+    }
+    return true;
+}
+
+std::vector<std::string> BindingCache::dependencies(std::string const& source_path) const
+{
+    std::scoped_lock lock(m_lock);
+    auto it = m_entries.find(source_path);
+    if (it == m_entries.end())
+        return {};
+
+    std::vector<std::string> paths;
+    paths.reserve(it->second.dependencies.size());
+    for (auto const& dependency : it->second.dependencies)
+        paths.push_back(dependency.path);
+    return paths;
+}
+
+std::string BindingCache::outputPath(std::string const& source_path) const
+{
+    std::scoped_lock lock(m_lock);
+    auto it = m_entries.find(source_path);
+    if (it == m_entries.end())
+        return {};
+    return it->second.output_path;
+}
+
+std::filesystem::path BindingCache::modelPathFor(std::string const& output_path) const
+{
+    return m_directory / "models" / (llvm::utohexstr(llvm::xxHash64(output_path)) + ".api.json");
+}
+
+void BindingCache::update(std::string const& source_path, std::string key, std::string output_path, std::vector<std::string> const& dependencies)
+{
+    std::vector<FileFingerprint> fingerprints;
+    fingerprints.reserve(dependencies.size());
+    for (auto const& dependency : dependencies) {
+        auto fingerprint = FileFingerprint::create(dependency);
+        if (!fingerprint.has_value()) {
+            // If we can't fingerprint one of the inputs, we can't prove the output is up to date next time.
+            forget(source_path);
+            return;
+        }
+        fingerprints.push_back(std::move(fingerprint.value()));
+    }
+    update(source_path, std::move(key), std::move(output_path), std::move(fingerprints));
+}
+
+void BindingCache::update(std::string const& source_path, std::string key, std::string output_path, std::vector<FileFingerprint> dependencies)
+{
+    std::scoped_lock lock(m_lock);
+    m_entries[source_path] = Entry { .key = std::move(key), .output_path = std::move(output_path), .dependencies = std::move(dependencies) };
+}
+
+void BindingCache::forget(std::string const& source_path)
+{
+    std::scoped_lock lock(m_lock);
+    m_entries.erase(source_path);
+}
+
+void BindingCache::load()
+{
+    auto buffer = llvm::MemoryBuffer::getFile(manifestPath().string());
+    if (!buffer)
+        return;
+
+    auto manifest = llvm::json::parse(buffer.get()->getBuffer());
+    if (!manifest) {
+        llvm::errs() << "Ignoring malformed cache manifest " << manifestPath().string() << ": " << manifest.takeError() << "\n";
+        return;
+    }
+
+    auto const* root = manifest->getAsObject();
+    if (!root || getInteger(*root, "version") != s_manifest_version)
+        return;
+    auto const* entries = root->getObject("entries");
+    if (!entries)
+        return;
+
+    for (auto const& [source_path, value] : *entries) {
+        auto const* object = value.getAsObject();
+        if (!object)
+            continue;
+
+        Entry entry;
+        entry.key = getString(*object, "key");
+        entry.output_path = getString(*object, "output");
+        if (auto const* dependencies = object->getArray("dependencies")) {
+            for (auto const& dependency : *dependencies) {
+                auto const* fields = dependency.getAsObject();
+                if (!fields)
+                    continue;
+                entry.dependencies.push_back(FileFingerprint {
+                    .path = getString(*fields, "path"),
+                    .size = static_cast<uint64_t>(getInteger(*fields, "size")),
+                    .modification_time = getInteger(*fields, "mtime"),
+                    .content_hash = static_cast<uint64_t>(getInteger(*fields, "hash")),
+                });
+            }
+        }
+        m_entries[source_path.str()] = std::move(entry);
+    }
+}
+
+bool BindingCache::save() const
+{
+    llvm::json::Object entries;
+    {
+        std::scoped_lock lock(m_lock);
+        for (auto const& it : m_entries) {
+            llvm::json::Array dependencies;
+            for (auto const& dependency : it.second.dependencies) {
+                dependencies.push_back(llvm::json::Object {
+                    { "path", dependency.path },
+                    { "size", static_cast<int64_t>(dependency.size) },
+                    { "mtime", dependency.modification_time },
+                    { "hash", static_cast<int64_t>(dependency.content_hash) },
+                });
+            }
+            entries[it.first()] = llvm::json::Object {
+                { "key", it.second.key },
+                { "output", it.second.output_path },
+                { "dependencies", std::move(dependencies) },
+            };
+        }
+    }
+
+    // Renamed into place from a temporary file, so that an interrupted or concurrent run never leaves a truncated manifest behind.
+    auto error = llvm::writeToOutput(manifestPath().string(), [&](llvm::raw_ostream& os) {
+        os << llvm::json::Value(llvm::json::Object {
+            { "version", s_manifest_version },
+            { "entries", std::move(entries) },
+        });
+        return llvm::Error::success();
+    });
+    if (error) {
+        llvm::errs() << "Can't write cache manifest " << manifestPath().string() << ": " << llvm::toString(std::move(error)) << "\n";
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+// Identifies the exact contents of one input file.
+// The size and modification time let us skip rehashing files that haven't been touched since the last run.
+struct FileFingerprint {
+    std::string path;
+    uint64_t size { 0 };
+    int64_t modification_time { 0 };
+    uint64_t content_hash { 0 };
+
+    static std::optional<FileFingerprint> create(llvm::StringRef path);
+    // Of the contents that were actually read, which may differ from what's on disk by now.
+    static FileFingerprint create(llvm::StringRef path, int64_t modification_time, llvm::StringRef contents);
+
+    // Returns true if the file on disk still has the same contents as when this fingerprint was taken.
+    bool matchesFileOnDisk() const;
+};
+
+// Persistent manifest of the inputs that went into each generated .jakt file.
+// A header whose compile command, tool version and include closure are unchanged since the last
+// run doesn't need to be parsed again, as the existing output would be regenerated byte for byte.
+class BindingCache {
+public:
+    static std::unique_ptr<BindingCache> open(std::filesystem::path directory);
+
+    // The key covers everything other than file contents that influences the output for a header,
+    // i.e. the tool version, its compile commands, and the options passed to jakt-bindgen.
+    static std::string computeKey(llvm::ArrayRef<std::string> inputs);
+
+    std::filesystem::path const& directory() const { return m_directory; }
+
+    bool isUpToDate(std::string const& source_path, std::string const& key) const;
+    std::vector<std::string> dependencies(std::string const& source_path) const;
+
+    // The .jakt file recorded for a header, or an empty string if there's none.
+    std::string outputPath(std::string const& source_path) const;
+
+    // Where the API model of a binding is kept, so that its imports can be resolved again without parsing its header.
+    std::filesystem::path modelPathFor(std::string const& output_path) const;
+    void update(std::string const& source_path, std::string key, std::string output_path, std::vector<std::string> const& dependencies);
+    void update(std::string const& source_path, std::string key, std::string output_path, std::vector<FileFingerprint> dependencies);
+    void forget(std::string const& source_path);
+
+    bool save() const;
+
+private:
+    explicit BindingCache(std::filesystem::path directory);
+
+    void load();
+    std::filesystem::path manifestPath() const { return m_directory / "manifest.json"; }
+
+    struct Entry {
+        std::string key;
+        std::string output_path;
+        std::vector<FileFingerprint> dependencies;
+    };
+
+    std::filesystem::path m_directory;
+
+    mutable std::mutex m_lock;
+    llvm::StringMap<Entry> m_entries;
+};
+
+}
@@ -0,0 +1,615 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "BindingRunner.h"
+#include "AstSnapshotCache.h"
+#include "BindingCache.h"
+#include "CompileCommands.h"
+#include "Console.h"
+#include "FileSystemCache.h"
+#include "FileWatcher.h"
+#include "PrecompiledPrefix.h"
+#include "SourceFileHandler.h"
+#include "SymbolIndex.h"
+#include "TypeMap.h"
+#include <algorithm>
+#include <iterator>
+#include <llvm/ADT/StringSet.h>
+#include <clang/Serialization/PCHContainerOperations.h>
+#include <clang/Tooling/Tooling.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <memory>
+#include <optional>
+
+namespace jakt_bindgen {
+
+BindingRunner::BindingRunner(clang::tooling::CompilationDatabase const& compilations, BindingOptions options)
+    : m_compilations(compilations)
+    , m_options(std::move(options))
+{
+    if (!m_options.output)
+        m_options.output = &OutputSink::files();
+    if (!m_options.cache_dir.empty() && m_options.output != &OutputSink::files()) {
+        llvm::errs() << "Output doesn't go to disk, ignoring the cache directory\n";
+        m_options.cache_dir.clear();
+    }
+    if (m_options.report_memory && llvm::hardware_concurrency(m_options.jobs).compute_thread_count() > 1)
+        llvm::errs() << "The resident set is shared by all jobs, so the memory report of each header includes the headers processed alongside it\n";
+}
+
+BindingRunner::~BindingRunner() = default;
+
+int BindingRunner::run(std::vector<std::string> const& source_paths)
+{
+    m_next_work_item = 0;
+    m_saw_error = false;
+    m_saw_skipped_file = false;
+
+    if (!m_options.cache_dir.empty() && !m_cache) {
+        m_cache = BindingCache::open(m_options.cache_dir);
+        if (!m_cache)
+            return 1;
+    }
+
+    if (!m_options.ast_cache_dir.empty() && !m_ast_snapshots) {
+        m_ast_snapshots = AstSnapshotCache::open(m_options.ast_cache_dir);
+        if (!m_ast_snapshots)
+            return 1;
+    }
+
+    if (!m_options.symbol_index.empty() && !m_symbol_index) {
+        m_symbol_index = SymbolIndex::open(m_options.symbol_index);
+        if (!m_symbol_index)
+            return 1;
+    }
+
+    if (!m_type_map) {
+        m_type_map = m_options.type_map.empty() ? TypeMap::createDefault() : TypeMap::load(m_options.type_map.string());
+        if (!m_type_map)
+            return 1;
+    }
+
+    std::vector<PendingSource> pending;
+    std::vector<std::string> up_to_date;
+    {
+        llvm::TimeTraceScope scope("CheckCache");
+        pending = pendingSources(source_paths, up_to_date);
+    }
+
+    // Headers that aren't parsed still have to be watched through their whole include closure, which the cache remembers.
+    {
+        std::scoped_lock lock(m_dependencies_mutex);
+        for (auto const& source_path : up_to_date)
+            m_dependencies[source_path] = m_cache->dependencies(source_path);
+    }
+
+    // Ninja deletes a depfile once it has read it, so skipped headers need a new one on every run just like the others.
+    if (m_options.write_depfiles) {
+        for (auto const& source_path : up_to_date)
+            writeDepfile(source_path, m_cache->dependencies(source_path));
+    }
+
+    if (!pending.empty() && !m_options.precompiled_includes.empty() && !m_precompiled_prefix) {
+        llvm::TimeTraceScope scope("PrecompilePrefix");
+        for (auto const& source : pending) {
+            if (m_compilations.getCompileCommands(source.path).empty())
+                continue;
+            m_precompiled_prefix = PrecompiledPrefix::create(m_compilations, source.path, m_options.precompiled_includes, m_cache.get());
+            break;
+        }
+        if (!m_precompiled_prefix)
+            llvm::errs() << "Continuing without a precompiled include prefix\n";
+    }
+
+    m_file_system_cache = std::make_shared<FileSystemCache>();
+
+    auto strategy = llvm::hardware_concurrency(m_options.jobs);
+    auto thread_count = strategy.compute_thread_count();
+    auto worker_count = std::min<size_t>(thread_count, pending.size());
+
+    // Shared by every worker to render the classes of large headers concurrently. It only gets the threads
+    // the workers leave over, so that the two together never run more than the requested number of jobs.
+    std::unique_ptr<llvm::ThreadPool> generation_pool;
+    if (auto spare_count = thread_count - std::max<size_t>(worker_count, 1); spare_count > 1) {
+        auto generation_strategy = strategy;
+        generation_strategy.ThreadsRequested = spare_count;
+        generation_pool = std::make_unique<llvm::ThreadPool>(generation_strategy);
+    }
+
+    std::vector<WorkItem> work;
+    if (m_options.umbrella) {
+        // One umbrella per worker keeps every core busy while parsing shared dependencies as few times as possible.
+        auto umbrella_count = std::max<size_t>(worker_count, 1);
+        auto umbrella_size = (pending.size() + umbrella_count - 1) / umbrella_count;
+        for (size_t i = 0; i < pending.size(); i += umbrella_size)
+            work.emplace_back(pending.begin() + i, pending.begin() + std::min(i + umbrella_size, pending.size()));
+    } else {
+        for (auto& source : pending)
+            work.push_back({ std::move(source) });
+    }
+
+    if (worker_count <= 1) {
+        runWorker(work, generation_pool.get());
+    } else {
+        auto worker_strategy = strategy;
+        worker_strategy.ThreadsRequested = worker_count;
+        llvm::ThreadPool pool(worker_strategy);
+        for (size_t i = 0; i < worker_count; ++i)
+            pool.async([this, &work, &generation_pool] { runWorker(work, generation_pool.get()); });
+        pool.wait();
+    }
+
+    bool wrote_deferred_bindings = true;
+    if (m_symbol_index) {
+        llvm::TimeTraceScope scope("GenerateDeferredBindings");
+        // The workers are done, so the deferred bindings can use every thread.
+        generation_pool.reset();
+        if (thread_count > 1)
+            generation_pool = std::make_unique<llvm::ThreadPool>(strategy);
+        if (!m_symbol_index->save())
+            m_saw_error = true;
+        SourceFileHandler::WriteOptions write_options {
+            .type_map = *m_type_map,
+            .output = *m_options.output,
+            .symbol_index = m_symbol_index.get(),
+            .emit_api_model = m_options.emit_api_model,
+            .generation_pool = generation_pool.get(),
+        };
+        for (auto& binding : m_deferred_bindings) {
+            if (!SourceFileHandler::writeBindings(binding.model, binding.output_path, write_options) || (m_cache && !storeCachedModel(binding.model, binding.output_path)))
+                wrote_deferred_bindings = false;
+        }
+        m_deferred_bindings.clear();
+
+        // A header that wasn't processed again still imports from others, which may have started or stopped binding a type it uses.
+        for (auto const& source_path : up_to_date) {
+            if (!resolveCachedImports(source_path, write_options))
+                wrote_deferred_bindings = false;
+        }
+    }
+
+    // The manifest already lists the deferred bindings as written, so it can't be saved if any of them wasn't.
+    if (!wrote_deferred_bindings) {
+        m_saw_error = true;
+    } else if (m_cache) {
+        llvm::TimeTraceScope scope("SaveCache");
+        if (!m_cache->save())
+            m_saw_error = true;
+    }
+
+    if (m_ast_snapshots) {
+        llvm::TimeTraceScope scope("SaveAstSnapshotManifest");
+        if (!m_ast_snapshots->save())
+            m_saw_error = true;
+    }
+
+    if (m_options.report_file_system_cache) {
+        auto counters = m_file_system_cache->counters();
+        llvm::outs() << "File system cache: " << counters.status_hits << " of " << counters.status_hits + counters.status_misses << " stats and "
+                     << counters.read_hits << " of " << counters.read_hits + counters.read_misses << " reads were hits\n";
+    }
+    // The cached contents are only referenced by ASTs of this run, which are all gone by now.
+    m_file_system_cache.reset();
+
+    if (m_saw_error)
+        return 1;
+    if (m_saw_skipped_file)
+        return 2;
+    return 0;
+}
+
+std::vector<BindingRunner::PendingSource> BindingRunner::pendingSources(std::vector<std::string> const& source_paths, std::vector<std::string>& up_to_date) const
+{
+    std::vector<PendingSource> pending;
+    pending.reserve(source_paths.size());
+    llvm::StringSet<> seen;
+    for (auto const& source_path : source_paths) {
+        PendingSource source { std::filesystem::absolute(source_path).lexically_normal().string(), {} };
+        // The same header may be both listed explicitly and discovered, or listed twice under different spellings.
+        if (!seen.insert(source.path).second)
+            continue;
+        if (m_cache) {
+            auto commands = m_compilations.getCompileCommands(source.path);
+            if (!commands.empty()) {
+                source.cache_key = cacheKeyFor(commands);
+                // With a symbol index, the imports of a skipped header are resolved again from its cached model.
+                if (m_cache->isUpToDate(source.path, source.cache_key)
+                    && (!m_symbol_index || std::filesystem::exists(m_cache->modelPathFor(m_cache->outputPath(source.path))))) {
+                    up_to_date.push_back(std::move(source.path));
+                    continue;
+                }
+            }
+        }
+        pending.push_back(std::move(source));
+    }
+    return pending;
+}
+
+void BindingRunner::runWorker(std::vector<WorkItem> const& work, llvm::ThreadPool* generation_pool)
+{
+    // The profiler is per thread. The thread that called run() already has one, pool threads need their own.
+    bool const owns_profiler = m_options.time_trace && !llvm::timeTraceProfilerEnabled();
+    if (owns_profiler)
+        llvm::timeTraceProfilerInitialize(m_options.time_trace_granularity, "jakt-bindgen");
+
+    SourceFileHandler handler(m_options.target_namespace, m_options.out_dir, m_options.base_dir);
+    handler.setEmitApiModel(m_options.emit_api_model);
+    handler.setReportMemory(m_options.report_memory);
+    handler.setSymbolIndex(m_symbol_index.get());
+    handler.setTypeMap(m_type_map.get());
+    handler.setGenerationPool(generation_pool);
+    handler.setOutputSink(m_options.output);
+    auto action = clang::tooling::newFrontendActionFactory(&handler.listener(), &handler);
+
+    for (size_t i = m_next_work_item++; i < work.size(); i = m_next_work_item++) {
+        auto const& item = work[i];
+        llvm::TimeTraceScope scope("ProcessHeader", [&] {
+            std::string detail = item.front().path;
+            if (item.size() > 1)
+                detail += " (+" + std::to_string(item.size() - 1) + " more)";
+            return detail;
+        });
+
+        // Each tool gets its own physical file system, so that the working directory changes ClangTool makes
+        // for each compile command stay local to this thread instead of calling chdir() on the whole process.
+        // Stats and reads go through the cache shared by every tool of the run.
+        clang::tooling::ClangTool tool(m_compilations, { item.front().path },
+            std::make_shared<clang::PCHContainerOperations>(), FileSystemCache::wrap(m_file_system_cache, llvm::vfs::createPhysicalFileSystem()));
+        if (m_precompiled_prefix)
+            tool.appendArgumentsAdjuster(m_precompiled_prefix->argumentsAdjuster());
+
+        std::string umbrella_path;
+        std::string umbrella_contents;
+        if (m_options.umbrella) {
+            // The umbrella only ever exists in memory. It's compiled with the command of the first header it includes.
+            umbrella_path = (m_options.out_dir / ("jakt-bindgen-umbrella-" + std::to_string(i) + ".cpp")).string();
+            std::vector<std::string> headers;
+            for (auto const& source : item) {
+                umbrella_contents += "#include \"" + source.path + "\"\n";
+                headers.push_back(source.path);
+            }
+            tool.mapVirtualFile(umbrella_path, umbrella_contents);
+            tool.appendArgumentsAdjuster(getReplaceInputFileAdjuster(umbrella_path));
+            handler.setUmbrellaHeaders(std::move(headers));
+        }
+
+        int result = 0;
+        if (m_ast_snapshots && !m_options.umbrella)
+            result = runWithAstSnapshot(tool, handler, item.front().path);
+        else
+            result = tool.run(action.get());
+
+        switch (result) {
+        case 0:
+            if (handler.write_failed())
+                m_saw_error = true;
+            recordResults(handler, item, umbrella_path);
+            if (m_symbol_index) {
+                std::scoped_lock lock(m_deferred_bindings_mutex);
+                std::ranges::move(handler.takeDeferredBindings(), std::back_inserter(m_deferred_bindings));
+            }
+            break;
+        case 2:
+            m_saw_skipped_file = true;
+            break;
+        default:
+            m_saw_error = true;
+            break;
+        }
+    }
+
+    if (owns_profiler)
+        llvm::timeTraceProfilerFinishThread();
+}
+
+int BindingRunner::runWithAstSnapshot(clang::tooling::ClangTool& tool, SourceFileHandler& handler, std::string const& source_path)
+{
+    auto key = AstSnapshotCache::computeKey(m_compilations.getCompileCommands(source_path),
+        m_precompiled_prefix ? m_precompiled_prefix->pchPath().string() : std::string {});
+
+    std::unique_ptr<clang::ASTUnit> unit;
+    {
+        llvm::TimeTraceScope scope("LoadAstSnapshot", source_path);
+        unit = m_ast_snapshots->load(source_path, key);
+    }
+
+    std::vector<std::string> dependencies;
+    if (unit) {
+        dependencies = m_ast_snapshots->dependencies(source_path);
+    } else {
+        // Same result codes as ClangTool::run, which buildASTs is a thin wrapper around.
+        std::vector<std::unique_ptr<clang::ASTUnit>> units;
+        if (auto result = tool.buildASTs(units); result != 0 || units.size() != 1)
+            return result != 0 ? result : 1;
+        unit = std::move(units.front());
+
+        dependencies = AstSnapshotCache::dependenciesOf(*unit);
+        // The snapshot refers to the PCH instead of containing its declarations, so it's only valid as long as the PCH is.
+        if (m_precompiled_prefix)
+            dependencies.push_back(m_precompiled_prefix->pchPath().string());
+
+        llvm::TimeTraceScope scope("SaveAstSnapshot", source_path);
+        m_ast_snapshots->store(*unit, source_path, key, dependencies);
+    }
+
+    return handler.processASTUnit(*unit, source_path, std::move(dependencies)) ? 0 : 1;
+}
+
+static int64_t modificationTimeOf(llvm::vfs::Status const& status)
+{
+    return status.getLastModificationTime().time_since_epoch().count();
+}
+
+// Fingerprints the dependencies as the TUs read them rather than as they are on disk by now,
+// so that a file edited while it was being parsed isn't recorded as up to date.
+static std::optional<std::vector<FileFingerprint>> fingerprintsAsRead(FileSystemCache const& file_system_cache, std::vector<std::string> const& dependencies)
+{
+    std::vector<FileFingerprint> fingerprints;
+    fingerprints.reserve(dependencies.size());
+    for (auto const& dependency : dependencies) {
+        auto read_file = file_system_cache.readFile(dependency);
+        if (read_file.has_value() && read_file->contents) {
+            fingerprints.push_back(FileFingerprint::create(dependency, modificationTimeOf(read_file->status), read_file->contents->getBuffer()));
+            continue;
+        }
+
+        // Too big to be cached, or not read by this run at all (e.g. the inputs of the PCH or of an AST snapshot).
+        auto fingerprint = FileFingerprint::create(dependency);
+        if (!fingerprint.has_value())
+            return {};
+        // A file that was read from disk directly must not have changed since.
+        if (read_file.has_value() && (fingerprint->size != read_file->status.getSize() || fingerprint->modification_time != modificationTimeOf(read_file->status)))
+            return {};
+        fingerprints.push_back(std::move(fingerprint.value()));
+    }
+    return fingerprints;
+}
+
+void BindingRunner::recordResults(SourceFileHandler const& handler, WorkItem const& item, std::string const& umbrella_path)
+{
+    // Umbrella headers share one include closure, so each of them conservatively depends on all of it.
+    auto dependencies = handler.dependencies();
+    std::erase(dependencies, umbrella_path);
+    if (m_precompiled_prefix)
+        dependencies.insert(dependencies.end(), m_precompiled_prefix->dependencies().begin(), m_precompiled_prefix->dependencies().end());
+
+    {
+        std::scoped_lock lock(m_dependencies_mutex);
+        for (auto const& source : item)
+            m_dependencies[source.path] = dependencies;
+    }
+
+    if (m_options.write_depfiles) {
+        for (auto const& source : item)
+            writeDepfile(source.path, dependencies);
+    }
+
+    if (!m_cache)
+        return;
+
+    auto fingerprints = fingerprintsAsRead(*m_file_system_cache, dependencies);
+    for (auto const& generated_file : handler.generated_files()) {
+        // Outside of umbrella mode, the handler only knows the header by the name used in its compile command.
+        auto const* source = &item.front();
+        if (item.size() > 1) {
+            auto it = std::find_if(item.begin(), item.end(), [&](auto const& s) { return s.path == generated_file.header_path; });
+            if (it == item.end())
+                continue;
+            source = &*it;
+        }
+        if (source->cache_key.empty())
+            continue;
+        // If we can't fingerprint one of the inputs, we can't prove the output is up to date next time.
+        if (!fingerprints.has_value()) {
+            m_cache->forget(source->path);
+            continue;
+        }
+        m_cache->update(source->path, source->cache_key, generated_file.output_path, fingerprints.value());
+
+        // A header without classes has no imports to resolve again, which its empty model says to resolveCachedImports().
+        if (generated_file.is_empty && m_symbol_index) {
+            ApiHeader model;
+            model.header_path = generated_file.header_path;
+            storeCachedModel(model, generated_file.output_path);
+        }
+    }
+}
+
+void BindingRunner::writeDepfile(std::string const& source_path, std::vector<std::string> const& dependencies)
+{
+    // Headers without any classes get an (empty) binding too, so every header gets a depfile.
+    auto relative_path = std::filesystem::canonical(source_path).lexically_relative(m_options.base_dir);
+    auto output_path = SourceFileHandler::outputPathFor(m_options.out_dir, relative_path).string();
+
+    // The header is listed first, even in umbrella mode where the closure starts with the umbrella's other headers.
+    std::vector<std::string> inputs { source_path };
+    inputs.insert(inputs.end(), dependencies.begin(), dependencies.end());
+    if (!SourceFileHandler::writeDepfile(*m_options.output, output_path, inputs))
+        m_saw_error = true;
+}
+
+bool BindingRunner::storeCachedModel(ApiHeader const& model, std::string const& output_path) const
+{
+    auto model_path = m_cache->modelPathFor(output_path);
+    std::error_code ec;
+    std::filesystem::create_directories(model_path.parent_path(), ec);
+    if (ec) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Can't create " << model_path.parent_path().string() << ": " << ec.message() << "\n";
+        return false;
+    }
+
+    // Always on disk, whatever the output sink of the run.
+    std::string json;
+    llvm::raw_string_ostream os(json);
+    model.write(os);
+    if (auto error = OutputSink::files().write(model_path.string(), os.str())) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Can't write cached model " << model_path.string() << ": " << llvm::toString(std::move(error)) << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool BindingRunner::resolveCachedImports(std::string const& source_path, SourceFileHandler::WriteOptions const& write_options) const
+{
+    auto output_path = m_cache->outputPath(source_path);
+    auto model = ApiHeader::read(m_cache->modelPathFor(output_path).string());
+    if (!model.has_value())
+        return false;
+    if (model->tags.empty())
+        return true;
+
+    // Rendered again from scratch. A binding whose imports didn't change renders the same, and the file is left alone.
+    return SourceFileHandler::writeBindings(model.value(), output_path, write_options);
+}
+
+int BindingRunner::watch(std::vector<std::string> const& source_paths)
+{
+    auto watcher = FileWatcher::create();
+
+    std::vector<std::string> sources;
+    for (auto const& source_path : source_paths)
+        sources.push_back(std::filesystem::absolute(source_path).lexically_normal().string());
+
+    // A header that fails is processed again once it changes, so a failed run doesn't end the watch.
+    if (run(sources) != 0)
+        llvm::errs() << "Not every header could be processed, watching for changes to them anyway\n";
+
+    for (;;) {
+        watcher->watch(watchedFiles(sources));
+        llvm::outs() << "Watching for changes...\n";
+        llvm::outs().flush();
+
+        auto maybe_changed_files = watcher->waitForChanges();
+        if (!maybe_changed_files.has_value())
+            return 1;
+        auto const& changed_files = maybe_changed_files.value();
+
+        // The PCH can't be loaded by clang once anything that went into it has changed, so build a new one.
+        if (m_precompiled_prefix) {
+            auto const& pch_dependencies = m_precompiled_prefix->dependencies();
+            bool pch_is_stale = std::any_of(changed_files.begin(), changed_files.end(), [&](auto const& file) {
+                return std::find(pch_dependencies.begin(), pch_dependencies.end(), file) != pch_dependencies.end();
+            });
+            if (pch_is_stale)
+                m_precompiled_prefix.reset();
+        }
+
+        auto affected = affectedSources(sources, changed_files);
+        llvm::outs() << changed_files.size() << " file(s) changed, regenerating " << affected.size() << " header(s)\n";
+        if (!affected.empty() && run(affected) != 0)
+            llvm::errs() << "Not every header could be processed, watching for changes to them anyway\n";
+    }
+}
+
+std::vector<std::string> BindingRunner::watchedFiles(std::vector<std::string> const& sources) const
+{
+    llvm::StringSet<> files;
+    {
+        std::scoped_lock lock(m_dependencies_mutex);
+        for (auto const& source : sources) {
+            files.insert(source);
+            if (auto it = m_dependencies.find(source); it != m_dependencies.end())
+                files.insert(it->second.begin(), it->second.end());
+        }
+    }
+
+    std::vector<std::string> result;
+    result.reserve(files.size());
+    for (auto const& file : files)
+        result.push_back(file.getKey().str());
+    return result;
+}
+
+std::vector<std::string> BindingRunner::affectedSources(std::vector<std::string> const& sources, std::vector<std::string> const& changed_files) const
+{
+    llvm::StringSet<> changed;
+    changed.insert(changed_files.begin(), changed_files.end());
+
+    std::scoped_lock lock(m_dependencies_mutex);
+    std::vector<std::string> affected;
+    for (auto const& source : sources) {
+        bool is_affected = changed.contains(source);
+        if (auto it = m_dependencies.find(source); !is_affected && it != m_dependencies.end())
+            is_affected = std::any_of(it->second.begin(), it->second.end(), [&](auto const& file) { return changed.contains(file); });
+        if (is_affected)
+            affected.push_back(source);
+    }
+    return affected;
+}
+
+std::string BindingRunner::cacheKeyFor(std::vector<clang::tooling::CompileCommand> const& commands) const
+{
+    std::vector<std::string> inputs {
+        m_options.target_namespace,
+        m_options.out_dir.string(),
+        m_options.base_dir.string(),
+        m_options.emit_api_model ? "api-model" : "",
+        m_options.symbol_index.empty() ? "" : "symbol-index",
+        m_options.write_depfiles ? "depfiles" : "",
+        m_type_map->fingerprint(),
+    };
+    for (auto const& command : commands) {
+        inputs.push_back(command.Directory);
+        inputs.insert(inputs.end(), command.CommandLine.begin(), command.CommandLine.end());
+    }
+    return BindingCache::computeKey(inputs);
+}
+
+// Every model has to be in the symbol index before the imports of any of them can be resolved.
+int generateFromApiModels(std::vector<std::string> const& model_paths, BindingOptions const& options)
+{
+    auto type_map = options.type_map.empty() ? TypeMap::createDefault() : TypeMap::load(options.type_map.string());
+    if (!type_map)
+        return 1;
+
+    std::unique_ptr<SymbolIndex> symbol_index;
+    if (!options.symbol_index.empty()) {
+        symbol_index = SymbolIndex::open(options.symbol_index);
+        if (!symbol_index)
+            return 1;
+    }
+
+    int result = 0;
+    std::vector<ApiHeader> models;
+    for (auto const& model_path : model_paths) {
+        auto model = ApiHeader::read(model_path);
+        if (!model.has_value()) {
+            result = 1;
+            continue;
+        }
+        if (symbol_index)
+            symbol_index->update(model.value());
+        models.push_back(std::move(model.value()));
+    }
+
+    if (symbol_index && !symbol_index->save())
+        result = 1;
+
+    std::unique_ptr<llvm::ThreadPool> generation_pool;
+    if (auto strategy = llvm::hardware_concurrency(options.jobs); strategy.compute_thread_count() > 1)
+        generation_pool = std::make_unique<llvm::ThreadPool>(strategy);
+
+    SourceFileHandler::WriteOptions write_options {
+        .type_map = *type_map,
+        .output = options.output ? *options.output : OutputSink::files(),
+        .symbol_index = symbol_index.get(),
+        .generation_pool = generation_pool.get(),
+    };
+    for (auto& model : models) {
+        auto output_path = SourceFileHandler::outputPathFor(options.out_dir, model.header_path).string();
+        if (!SourceFileHandler::writeBindings(model, output_path, write_options))
+            result = 1;
+    }
+    return result;
+}
+
+}
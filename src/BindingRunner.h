@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "OutputSink.h"
+#include "SourceFileHandler.h"
+#include <atomic>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <filesystem>
+#include <llvm/ADT/StringMap.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang::tooling {
+class ClangTool;
+}
+
+namespace llvm {
+class ThreadPool;
+}
+
+namespace jakt_bindgen {
+
+class AstSnapshotCache;
+class BindingCache;
+class FileSystemCache;
+class PrecompiledPrefix;
+class SymbolIndex;
+class TypeMap;
+
+struct BindingOptions {
+    std::string target_namespace;
+    std::filesystem::path out_dir;
+    std::filesystem::path base_dir;
+
+    // Receives every generated file, at the path it would have on disk under out_dir. Not owned, and written to from every
+    // worker. Files are written to disk when null. The manifest in cache_dir only tracks files on disk, so it's ignored otherwise.
+    OutputSink* output { nullptr };
+
+    // Number of headers to process concurrently, and of threads rendering the classes of a header. 0 means use every available core.
+    unsigned jobs { 1 };
+
+    // Directory holding the incremental build manifest. Headers are always reprocessed when empty.
+    std::filesystem::path cache_dir;
+
+    // Directory holding serialized ASTs of the headers, which are loaded instead of parsing a header again while its
+    // compile command and include closure are unchanged. Unlike the manifest in cache_dir, they're shared between runs with
+    // different options. Not used in umbrella mode.
+    std::filesystem::path ast_cache_dir;
+
+    // Headers included by (nearly) every header being bound. When set, they're precompiled once and
+    // the PCH is loaded by each translation unit instead of parsing them over and over.
+    std::vector<std::string> precompiled_includes;
+
+    // Parse the headers as one synthesized translation unit per worker that includes all of them, instead of one TU per header.
+    // Every header in an umbrella is compiled with the flags of its first header.
+    bool umbrella { false };
+
+    // Also write the API model each .jakt file is generated from, so it can be regenerated later with --from-api-model.
+    bool emit_api_model { false };
+
+    // File mapping each bound type to the header that binds it. When set, every binding imports exactly the bound types
+    // its signatures and bases use, instead of only the bases declared in other headers. It's updated with the headers of
+    // each run, and used to resolve imports from headers that aren't processed again.
+    std::filesystem::path symbol_index;
+
+    // JSON file with mappings of C++ types to Jakt types, on top of (or replacing) the built-in ones.
+    std::filesystem::path type_map;
+
+    // Write a Make-style depfile next to every generated file, listing its header and the header's include closure,
+    // so that build systems like Ninja only rerun jakt-bindgen when one of them changes.
+    bool write_depfiles { false };
+
+    // Print the resident set size after each translation unit, and how much it grew while processing it.
+    // The resident set is shared by the whole process, so with more than one job the growth includes concurrent TUs.
+    bool report_memory { false };
+
+    // Print how many stats and reads were answered by the file system cache shared by the translation units of a run.
+    bool report_file_system_cache { false };
+
+    // Record a time trace on every worker thread, in addition to the thread calling run().
+    // The caller is responsible for setting up the profiler on its own thread and for writing the trace out.
+    bool time_trace { false };
+    unsigned time_trace_granularity { 500 };
+};
+
+// Generates the bindings of API models written by emit_api_model, without parsing any C++.
+// Uses the output, type map, symbol index and job count of the options. Returns 0 on success and 1 if any model failed.
+int generateFromApiModels(std::vector<std::string> const& model_paths, BindingOptions const& options);
+
+// Drives a SourceFileHandler over every requested header.
+// Each worker thread owns its own handler (and therefore its own listener),
+// and pulls the next translation unit off a shared queue when it's done with the previous one.
+class BindingRunner {
+public:
+    BindingRunner(clang::tooling::CompilationDatabase const& compilations, BindingOptions options);
+    ~BindingRunner();
+
+    // Returns 0 on success, 1 if any header failed to process, and 2 if any header was skipped.
+    // Mirrors the return value of clang::tooling::ClangTool::run.
+    int run(std::vector<std::string> const& source_paths);
+
+    // Runs once, then keeps running until killed: whenever one of the headers or a file in its include closure changes,
+    // only the headers affected by the change are processed again. The compilation database, the PCH and the cache stay
+    // loaded in between. Only returns, with 1, if changes can't be waited for anymore.
+    int watch(std::vector<std::string> const& source_paths);
+
+private:
+    struct PendingSource {
+        std::string path;
+        std::string cache_key;
+    };
+
+    // The headers parsed together in one translation unit. Holds a single header unless in umbrella mode.
+    using WorkItem = std::vector<PendingSource>;
+
+    // The headers that have to be processed. The ones the cache says are up to date are added to up_to_date instead.
+    std::vector<PendingSource> pendingSources(std::vector<std::string> const& source_paths, std::vector<std::string>& up_to_date) const;
+    std::string cacheKeyFor(std::vector<clang::tooling::CompileCommand> const& commands) const;
+
+    void runWorker(std::vector<WorkItem> const& work, llvm::ThreadPool* generation_pool);
+    int runWithAstSnapshot(clang::tooling::ClangTool& tool, SourceFileHandler& handler, std::string const& source_path);
+    void recordResults(SourceFileHandler const& handler, WorkItem const& item, std::string const& umbrella_path);
+    bool storeCachedModel(ApiHeader const& model, std::string const& output_path) const;
+    bool resolveCachedImports(std::string const& source_path, SourceFileHandler::WriteOptions const& write_options) const;
+    void writeDepfile(std::string const& source_path, std::vector<std::string> const& dependencies);
+
+    std::vector<std::string> watchedFiles(std::vector<std::string> const& sources) const;
+    std::vector<std::string> affectedSources(std::vector<std::string> const& sources, std::vector<std::string> const& changed_files) const;
+
+    clang::tooling::CompilationDatabase const& m_compilations;
+    BindingOptions m_options;
+    std::unique_ptr<BindingCache> m_cache;
+    std::unique_ptr<AstSnapshotCache> m_ast_snapshots;
+    std::unique_ptr<SymbolIndex> m_symbol_index;
+    std::unique_ptr<TypeMap> m_type_map;
+
+    // Replaced by every run, as files may have changed in between.
+    std::shared_ptr<FileSystemCache> m_file_system_cache;
+    std::unique_ptr<PrecompiledPrefix> m_precompiled_prefix;
+
+    std::atomic<size_t> m_next_work_item { 0 };
+    std::atomic<bool> m_saw_error { false };
+    std::atomic<bool> m_saw_skipped_file { false };
+
+    // Bindings waiting for every header of the run to be in the symbol index.
+    std::mutex m_deferred_bindings_mutex;
+    std::vector<SourceFileHandler::DeferredBinding> m_deferred_bindings;
+
+    // The include closure of every header processed so far, for watch mode.
+    mutable std::mutex m_dependencies_mutex;
+    llvm::StringMap<std::vector<std::string>> m_dependencies;
+};
+
+}
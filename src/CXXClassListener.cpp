@@ -5,79 +5,212 @@
  */
 
 #include "CXXClassListener.h"
-#include <algorithm>
+#include <clang/AST/ASTConsumer.h>
 #include <clang/AST/Decl.h>
 #include <clang/AST/DeclCXX.h>
+#include <clang/AST/DeclTemplate.h>
 #include <clang/AST/PrettyPrinter.h>
 #include <clang/AST/Type.h>
-#include <clang/ASTMatchers/ASTMatchFinder.h>
-#include <clang/ASTMatchers/ASTMatchers.h>
 #include <clang/Basic/Specifiers.h>
 #include <filesystem>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/ADT/StringRef.h>
 #include <llvm/Support/Casting.h>
 #include <llvm/Support/Error.h>
 #include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/TimeProfiler.h>
 #include <vector>
 
+#define DEBUG_TYPE "class-listener"
+
 namespace jakt_bindgen {
 
-using namespace clang::ast_matchers;
+ALWAYS_ENABLED_STATISTIC(NumTopLevelDecls, "Top level declarations handed to the listener");
+ALWAYS_ENABLED_STATISTIC(NumClassesCollected, "Classes collected");
+ALWAYS_ENABLED_STATISTIC(NumEnumsCollected, "Enums collected");
+ALWAYS_ENABLED_STATISTIC(NumMethodsCollected, "Methods collected");
+ALWAYS_ENABLED_STATISTIC(NumMethodsSkippedOperator, "Destructors, conversions and operators skipped");
+ALWAYS_ENABLED_STATISTIC(NumConstructorsSkipped, "Copy, move and deleted constructors skipped");
+
+namespace {
+
+class TopLevelDeclConsumer : public clang::ASTConsumer {
+public:
+    explicit TopLevelDeclConsumer(CXXClassListener& listener)
+        : m_listener(listener)
+    {
+    }
+
+    virtual bool HandleTopLevelDecl(clang::DeclGroupRef group) override
+    {
+        m_top_level_decls.insert(m_top_level_decls.end(), group.begin(), group.end());
+        NumTopLevelDecls += group.end() - group.begin();
+        return true;
+    }
+
+    virtual void HandleTranslationUnit(clang::ASTContext& context) override
+    {
+        m_listener.collect(context, m_top_level_decls);
+    }
+
+private:
+    CXXClassListener& m_listener;
+    std::vector<clang::Decl const*> m_top_level_decls;
+};
+
+}
 
-CXXClassListener::CXXClassListener(std::string namespace_, clang::ast_matchers::MatchFinder& finder)
+CXXClassListener::CXXClassListener(std::string namespace_)
     : m_namespace(std::move(namespace_))
-    , m_finder(finder)
 {
-    registerMatches();
 }
 
 CXXClassListener::~CXXClassListener()
 {
 }
 
-void CXXClassListener::registerMatches()
+std::unique_ptr<clang::ASTConsumer> CXXClassListener::newASTConsumer()
 {
-    m_finder.addMatcher(traverse(clang::TK_IgnoreUnlessSpelledInSource,
-                            recordDecl(decl().bind("toplevel-name"),
-                                hasParent(namespaceDecl(hasName(m_namespace))),
-                                isExpansionInMainFile(),
-                                forEachDescendant(cxxMethodDecl(unless(isPrivate())).bind("toplevel-method")))),
-        this);
-
-    // Note: Matches *namespace scope* enums.
-    //       Nested class enums are handled separately.
-    m_finder.addMatcher(traverse(clang::TK_IgnoreUnlessSpelledInSource,
-                            enumDecl(decl().bind("toplevel-enum"),
-                                hasParent(namespaceDecl(hasName(m_namespace))),
-                                isExpansionInMainFile())),
-        this);
+    return std::make_unique<TopLevelDeclConsumer>(*this);
 }
 
-void CXXClassListener::run(MatchFinder::MatchResult const& Result)
+void CXXClassListener::collect(clang::ASTContext& context, llvm::ArrayRef<clang::Decl const*> top_level_decls)
 {
-    if (clang::RecordDecl const* RD = Result.Nodes.getNodeAs<clang::RecordDecl>("toplevel-name")) {
-        if (RD->isClass())
-            visitClass(llvm::cast<clang::CXXRecordDecl>(RD->getDefinition()), Result.SourceManager);
+    llvm::TimeTraceScope scope("CollectDecls");
+
+    // Anything still here points into an AST that has been (or is about to be) freed, and would be mixed into this TU's bindings.
+    if (holdsDecls())
+        llvm::report_fatal_error("CXXClassListener still holds declarations of a previous translation unit", false);
+
+    m_source_manager = &context.getSourceManager();
+    m_known_decls.emplace(context);
+
+    for (clang::Decl const* decl : top_level_decls) {
+        if (!isInBoundFile(decl->getBeginLoc(), *m_source_manager))
+            continue;
+        if (auto const* namespace_declaration = llvm::dyn_cast<clang::NamespaceDecl>(decl))
+            visitDeclContext(namespace_declaration, isTargetNamespace(namespace_declaration));
+        else if (auto const* linkage_spec = llvm::dyn_cast<clang::LinkageSpecDecl>(decl))
+            visitDeclContext(linkage_spec, false);
     }
-    if (clang::CXXMethodDecl const* MD = Result.Nodes.getNodeAs<clang::CXXMethodDecl>("toplevel-method")) {
-        visitClassMethod(MD);
+}
+
+bool CXXClassListener::isTargetNamespace(clang::NamespaceDecl const* namespace_declaration) const
+{
+    // Same rules as the hasName() AST matcher: an unqualified name matches a namespace with that name anywhere,
+    // a qualified one has to match the trailing components of the fully qualified name.
+    llvm::StringRef target = m_namespace;
+    if (!target.contains("::"))
+        return namespace_declaration->getName() == target;
+
+    auto qualified_name = namespace_declaration->getQualifiedNameAsString();
+    if (target.consume_front("::"))
+        return qualified_name == target;
+    return qualified_name == target || llvm::StringRef(qualified_name).endswith(("::" + target).str());
+}
+
+// Classes are only bound if they, or a class nested in them, have a method that isn't private.
+// Same rule as the forEachDescendant(cxxMethodDecl(unless(isPrivate()))) AST matcher this pass replaced.
+static bool hasNonPrivateMethod(clang::CXXRecordDecl const* class_definition)
+{
+    for (clang::Decl const* member : class_definition->decls()) {
+        if (member->isImplicit())
+            continue;
+        if (llvm::isa<clang::CXXMethodDecl>(member) || llvm::isa<clang::FunctionTemplateDecl>(member)) {
+            if (member->getAccess() != clang::AS_private)
+                return true;
+        } else if (auto const* nested_class = llvm::dyn_cast<clang::CXXRecordDecl>(member)) {
+            if (hasNonPrivateMethod(nested_class))
+                return true;
+        }
     }
-    if (clang::EnumDecl const* ED = Result.Nodes.getNodeAs<clang::EnumDecl>("toplevel-enum")) {
-        visitEnumeration(ED);
+    return false;
+}
+
+void CXXClassListener::visitDeclContext(clang::DeclContext const* decl_context, bool in_target_namespace)
+{
+    for (clang::Decl const* decl : decl_context->decls()) {
+        if (decl->isImplicit() || !isInBoundFile(decl->getBeginLoc(), *m_source_manager))
+            continue;
+
+        if (auto const* namespace_declaration = llvm::dyn_cast<clang::NamespaceDecl>(decl)) {
+            visitDeclContext(namespace_declaration, isTargetNamespace(namespace_declaration));
+        } else if (auto const* linkage_spec = llvm::dyn_cast<clang::LinkageSpecDecl>(decl)) {
+            // extern "C++" { } blocks are transparent to name lookup, so their contents live in the enclosing namespace.
+            visitDeclContext(linkage_spec, in_target_namespace);
+        } else if (!in_target_namespace) {
+            continue;
+        } else if (auto const* record = llvm::dyn_cast<clang::CXXRecordDecl>(decl)) {
+            if (record->isClass() && record->getDefinition() && hasNonPrivateMethod(record->getDefinition()))
+                visitClass(record->getDefinition());
+        } else if (auto const* enum_declaration = llvm::dyn_cast<clang::EnumDecl>(decl)) {
+            visitEnumeration(enum_declaration);
+        }
     }
 }
 
 void CXXClassListener::resetForNextFile()
 {
-    m_tag_decls.clear();
-    m_imports.clear();
+    m_headers.clear();
+    m_methods.clear();
+    m_nested_tags.clear();
+    m_visited_tags.clear();
+    m_known_decls.reset();
+    m_source_manager = nullptr;
+}
+
+bool CXXClassListener::holdsDecls() const
+{
+    if (!m_methods.empty() || !m_nested_tags.empty() || !m_visited_tags.empty())
+        return true;
+    for (auto const& header : m_headers) {
+        if (!header.second.tag_decls.empty() || !header.second.imports.empty())
+            return true;
+    }
+    return false;
+}
+
+void CXXClassListener::setBoundFiles(std::vector<clang::FileEntry const*> files)
+{
+    m_headers.clear();
+    for (auto const* file : files)
+        m_headers.try_emplace(file);
 }
 
-void CXXClassListener::visitClass(clang::CXXRecordDecl const* class_definition, clang::SourceManager const* source_manager)
+bool CXXClassListener::isInBoundFile(clang::SourceLocation location, clang::SourceManager const& source_manager) const
 {
-    if (std::find(m_tag_decls.begin(), m_tag_decls.end(), class_definition) != m_tag_decls.end())
+    auto file_id = source_manager.getFileID(source_manager.getExpansionLoc(location));
+    return m_headers.count(source_manager.getFileEntryForID(file_id)) != 0;
+}
+
+CXXClassListener::HeaderDecls const& CXXClassListener::declsFor(clang::FileEntry const* file) const
+{
+    static HeaderDecls const empty;
+    auto it = m_headers.find(file);
+    if (it == m_headers.end())
+        return empty;
+    return it->second;
+}
+
+clang::FileEntry const* CXXClassListener::fileOf(clang::Decl const* decl, clang::SourceManager const& source_manager)
+{
+    return source_manager.getFileEntryForID(source_manager.getFileID(source_manager.getExpansionLoc(decl->getBeginLoc())));
+}
+
+void CXXClassListener::visitClass(clang::CXXRecordDecl const* class_definition)
+{
+    // A forward declaration in one bound file may refer to a class defined somewhere else.
+    // Attribute the class to the file with its definition, if we're binding that file at all.
+    auto header = m_headers.find(fileOf(class_definition, *m_source_manager));
+    if (header == m_headers.end())
+        return;
+
+    if (!m_visited_tags.insert(class_definition).second)
         return;
 
-    m_tag_decls.push_back(class_definition);
+    header->second.tag_decls.push_back(class_definition);
+    ++NumClassesCollected;
+    visitClassMembers(class_definition);
 
     // Visit bases and add to import list
     for (clang::CXXBaseSpecifier const& base : class_definition->bases()) {
@@ -91,14 +224,45 @@ void CXXClassListener::visitClass(clang::CXXRecordDecl const* class_definition,
         if (!base_record)
             llvm::report_fatal_error("ERROR: Base class unusable", false);
 
-        if (source_manager->isInMainFile(source_manager->getExpansionLoc(base_record->getBeginLoc()))) {
+        if (fileOf(base_record, *m_source_manager) == header->first) {
             continue;
         }
-        auto base_class_name = base_record->getQualifiedNameAsString();
-        if (base_class_name == "AK::RefCounted" || base_class_name == "AK::Weakable")
+        auto base_template = m_known_decls->templateOf(base_record);
+        if (base_template == KnownDecls::Template::RefCounted || base_template == KnownDecls::Template::Weakable)
             continue;
 
-        m_imports.push_back(base_record);
+        header->second.imports.push_back(base_record);
+    }
+}
+
+std::vector<clang::TagDecl const*> const& CXXClassListener::nested_tags_for(clang::CXXRecordDecl const* r) const
+{
+    static std::vector<clang::TagDecl const*> const empty;
+    auto it = m_nested_tags.find(r);
+    if (it == m_nested_tags.end())
+        return empty;
+    return it->second;
+}
+
+void CXXClassListener::visitClassMembers(clang::CXXRecordDecl const* class_definition)
+{
+    for (clang::Decl const* member : class_definition->decls()) {
+        // Skips the implicit injected-class-name and special members, along with anything else not spelled in the source.
+        if (member->isImplicit())
+            continue;
+
+        if (auto const* method = llvm::dyn_cast<clang::CXXMethodDecl>(member)) {
+            if (method->getAccess() != clang::AS_private)
+                visitClassMethod(method);
+        } else if (auto const* method_template = llvm::dyn_cast<clang::FunctionTemplateDecl>(member)) {
+            auto const* templated_method = llvm::dyn_cast<clang::CXXMethodDecl>(method_template->getTemplatedDecl());
+            if (templated_method && method_template->getAccess() != clang::AS_private)
+                visitClassMethod(templated_method);
+        } else if (auto const* nested_tag = llvm::dyn_cast<clang::TagDecl>(member)) {
+            m_nested_tags[class_definition].push_back(nested_tag);
+            if (auto const* nested_class = llvm::dyn_cast<clang::CXXRecordDecl>(nested_tag))
+                visitClassMembers(nested_class);
+        }
     }
 }
 
@@ -108,27 +272,36 @@ void CXXClassListener::visitClassMethod(clang::CXXMethodDecl const* method_decla
         if (llvm::isa<clang::CXXDestructorDecl>(method_declaration)
             || llvm::isa<clang::CXXConversionDecl>(method_declaration)
             || method_declaration->isOverloadedOperator()) {
+            ++NumMethodsSkippedOperator;
             return;
         }
         if (clang::CXXConstructorDecl const* ctor = llvm::dyn_cast<clang::CXXConstructorDecl>(method_declaration)) {
             // Allow public default constructors to pass through, along with ctors with parameters
-            if (ctor->isCopyOrMoveConstructor() || ctor->isDeleted())
+            if (ctor->isCopyOrMoveConstructor() || ctor->isDeleted()) {
+                ++NumConstructorsSkipped;
                 return;
+            }
         }
-        // TODO: Walk instance method parameters and return type to find new types to add to imports
+        // The types in the signature are picked up by ApiModelBuilder, and resolved to imports with a SymbolIndex.
         m_methods[method_declaration->getParent()].push_back(method_declaration);
+        ++NumMethodsCollected;
     } else if (method_declaration->isStatic()) {
-        // TODO: Walk static method parameters and return type to find new types to add to imports
         m_methods[method_declaration->getParent()].push_back(method_declaration);
+        ++NumMethodsCollected;
     }
 }
 
 void CXXClassListener::visitEnumeration(clang::EnumDecl const* enum_declaration)
 {
-    if (std::find(m_tag_decls.begin(), m_tag_decls.end(), enum_declaration) != m_tag_decls.end())
+    auto header = m_headers.find(fileOf(enum_declaration, *m_source_manager));
+    if (header == m_headers.end())
+        return;
+
+    if (!m_visited_tags.insert(enum_declaration).second)
         return;
 
-    m_tag_decls.push_back(enum_declaration);
+    header->second.tag_decls.push_back(enum_declaration);
+    ++NumEnumsCollected;
 }
 
 }
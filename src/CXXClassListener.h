@@ -6,45 +6,83 @@
 
 #pragma once
 
+#include "KnownDecls.h"
+#include <clang/AST/ASTConsumer.h>
+#include <clang/AST/ASTContext.h>
 #include <clang/AST/Decl.h>
 #include <clang/AST/DeclCXX.h>
-#include <clang/ASTMatchers/ASTMatchFinder.h>
-#include <clang/ASTMatchers/ASTMatchers.h>
+#include <clang/Basic/FileManager.h>
 #include <clang/Basic/SourceManager.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
 #include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace jakt_bindgen {
 
-class CXXClassListener : public clang::ast_matchers::MatchFinder::MatchCallback {
+// Collects the classes and enums of the target namespace declared in the bound files of a translation unit.
+// Only the top level declarations parsed for the TU are walked, and any that don't come from a bound file are
+// skipped without looking inside them, so included headers (and PCH contents) cost next to nothing.
+class CXXClassListener {
 public:
-    CXXClassListener(std::string namespace_, clang::ast_matchers::MatchFinder&);
-    virtual ~CXXClassListener() override;
+    explicit CXXClassListener(std::string namespace_);
+    ~CXXClassListener();
 
-    virtual void run(clang::ast_matchers::MatchFinder::MatchResult const& result) override;
+    // For use with clang::tooling::newFrontendActionFactory.
+    // The returned consumer hands the TU's top level declarations to collect() once parsing is done.
+    std::unique_ptr<clang::ASTConsumer> newASTConsumer();
 
-    std::vector<clang::TagDecl const*> const& tag_decls() const { return m_tag_decls; }
-    std::vector<clang::TagDecl const*> const& imports() const { return m_imports; }
+    void collect(clang::ASTContext& context, llvm::ArrayRef<clang::Decl const*> top_level_decls);
+
+    // Declarations are collected from, and attributed to, the bound files only.
+    // Normally that's just the main file, but a synthesized umbrella TU binds every header it includes.
+    void setBoundFiles(std::vector<clang::FileEntry const*> files);
+    bool isInBoundFile(clang::SourceLocation location, clang::SourceManager const& source_manager) const;
+
+    std::vector<clang::TagDecl const*> const& tag_decls(clang::FileEntry const* file) const { return declsFor(file).tag_decls; }
+    std::vector<clang::TagDecl const*> const& imports(clang::FileEntry const* file) const { return declsFor(file).imports; }
     std::vector<clang::CXXMethodDecl const*> const& methods_for(clang::CXXRecordDecl const* r) const { return m_methods.at(r); }
     bool contains_methods_for(clang::CXXRecordDecl const* r) const { return m_methods.contains(r); }
+    std::vector<clang::TagDecl const*> const& nested_tags_for(clang::CXXRecordDecl const* r) const;
 
+    // Resolved when collection of a translation unit starts.
+    KnownDecls const& known_decls() const { return m_known_decls.value(); }
+
+    // Releases everything collected from the current translation unit. Must be called before its AST is destroyed:
+    // collect() refuses to run while declarations of a previous translation unit are still held on to.
     void resetForNextFile();
 
 private:
-    void visitClass(clang::CXXRecordDecl const* class_definition, clang::SourceManager const* source_manager);
+    struct HeaderDecls {
+        std::vector<clang::TagDecl const*> tag_decls;
+        std::vector<clang::TagDecl const*> imports;
+    };
+
+    HeaderDecls const& declsFor(clang::FileEntry const* file) const;
+    bool holdsDecls() const;
+    static clang::FileEntry const* fileOf(clang::Decl const* decl, clang::SourceManager const& source_manager);
+
+    bool isTargetNamespace(clang::NamespaceDecl const* namespace_declaration) const;
+
+    void visitDeclContext(clang::DeclContext const* decl_context, bool in_target_namespace);
+    void visitClass(clang::CXXRecordDecl const* class_definition);
+    void visitClassMembers(clang::CXXRecordDecl const* class_definition);
     void visitClassMethod(clang::CXXMethodDecl const* method_declaration);
     void visitEnumeration(clang::EnumDecl const* enum_declaration);
 
-    void registerMatches();
-
     std::string m_namespace;
+    clang::SourceManager const* m_source_manager { nullptr };
 
-    std::vector<clang::TagDecl const*> m_tag_decls;
-    std::vector<clang::TagDecl const*> m_imports;
+    llvm::DenseMap<clang::FileEntry const*, HeaderDecls> m_headers;
+    std::optional<KnownDecls> m_known_decls;
 
     std::unordered_map<clang::CXXRecordDecl const*, std::vector<clang::CXXMethodDecl const*>> m_methods;
-
-    clang::ast_matchers::MatchFinder& m_finder;
+    std::unordered_map<clang::CXXRecordDecl const*, std::vector<clang::TagDecl const*>> m_nested_tags;
+    llvm::DenseSet<clang::TagDecl const*> m_visited_tags;
 };
 
 }
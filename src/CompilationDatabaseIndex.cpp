@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "CompilationDatabaseIndex.h"
+#include "BindingCache.h"
+#include <clang/Tooling/JSONCompilationDatabase.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/EndianStream.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FileUtilities.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <mutex>
+
+namespace jakt_bindgen {
+
+// Layout of an index file, all integers little endian:
+//   magic, u32 version, u32 payload offset, u32 hash table offset,
+//   u64 size, i64 modification time and u64 content hash of the JSON, u32 length and bytes of the JSON's path,
+//   then the entries and buckets written by llvm::OnDiskChainedHashTableGenerator.
+// Each entry maps the real path of a file (or its normalized absolute path, if it doesn't exist) to its commands: u32 count, then for each command its directory,
+// file name and output, and u32 count and the arguments. Strings are a u32 length followed by the bytes.
+static constexpr llvm::StringLiteral s_magic = "JBCDBIDX";
+static constexpr uint32_t s_index_version = 2;
+static constexpr size_t s_payload_offset_position = s_magic.size() + sizeof(uint32_t);
+static constexpr size_t s_fixed_header_size = s_magic.size() + 4 * sizeof(uint32_t) + 3 * sizeof(uint64_t);
+
+using offset_type = uint32_t;
+using hash_value_type = uint32_t;
+
+// Same normalization as clang's JSONCompilationDatabase applies to the file names it indexes.
+static std::string normalizedPath(llvm::StringRef path, llvm::StringRef directory)
+{
+    llvm::SmallString<256> result;
+    if (llvm::sys::path::is_relative(path) && !directory.empty()) {
+        result = directory;
+        llvm::sys::path::append(result, path);
+    } else {
+        result = path;
+    }
+    llvm::sys::fs::make_absolute(result);
+    llvm::sys::path::remove_dots(result, /* remove_dot_dot = */ true);
+    llvm::sys::path::native(result);
+    return std::string(result.str());
+}
+
+// Symlinks are resolved on both sides, standing in for the FileMatchTrie that lets clang's JSON database find a file
+// by any path that's equivalent to the one in the database.
+static std::string realPath(std::string normalized_path)
+{
+    llvm::SmallString<256> result;
+    if (llvm::sys::fs::real_path(normalized_path, result))
+        return normalized_path;
+    return std::string(result.str());
+}
+
+static hash_value_type hashPath(llvm::StringRef path)
+{
+    return static_cast<hash_value_type>(llvm::xxHash64(path));
+}
+
+static offset_type encodedLength(llvm::StringRef string)
+{
+    return sizeof(offset_type) + string.size();
+}
+
+static void writeString(llvm::support::endian::Writer& writer, llvm::StringRef string)
+{
+    writer.write<offset_type>(string.size());
+    writer.OS << string;
+}
+
+static llvm::StringRef readString(unsigned char const*& data)
+{
+    auto length = llvm::support::endian::readNext<offset_type, llvm::support::little, llvm::support::unaligned>(data);
+    llvm::StringRef string(reinterpret_cast<char const*>(data), length);
+    data += length;
+    return string;
+}
+
+namespace {
+
+// Doesn't own the database it forwards to, so that the interpolating database below can be built on top of one that's kept.
+class BorrowedDatabase : public clang::tooling::CompilationDatabase {
+public:
+    explicit BorrowedDatabase(clang::tooling::CompilationDatabase const& database)
+        : m_database(database)
+    {
+    }
+
+    std::vector<clang::tooling::CompileCommand> getCompileCommands(llvm::StringRef file_path) const override { return m_database.getCompileCommands(file_path); }
+    std::vector<std::string> getAllFiles() const override { return m_database.getAllFiles(); }
+    std::vector<clang::tooling::CompileCommand> getAllCompileCommands() const override { return m_database.getAllCompileCommands(); }
+
+private:
+    clang::tooling::CompilationDatabase const& m_database;
+};
+
+// Building clang's interpolating database lists every file of the database, which for the index means decoding every key.
+// Files with commands of their own don't need it, so it's only built by the first lookup that misses.
+class LazilyInterpolatingDatabase : public clang::tooling::CompilationDatabase {
+public:
+    explicit LazilyInterpolatingDatabase(std::unique_ptr<clang::tooling::CompilationDatabase> database)
+        : m_database(std::move(database))
+    {
+    }
+
+    std::vector<clang::tooling::CompileCommand> getCompileCommands(llvm::StringRef file_path) const override
+    {
+        if (auto commands = m_database->getCompileCommands(file_path); !commands.empty())
+            return commands;
+
+        // Lookups come from every worker at once.
+        std::call_once(m_interpolated_once, [this] {
+            m_interpolated = clang::tooling::inferMissingCompileCommands(std::make_unique<BorrowedDatabase>(*m_database));
+        });
+        return m_interpolated->getCompileCommands(file_path);
+    }
+
+    std::vector<std::string> getAllFiles() const override { return m_database->getAllFiles(); }
+    std::vector<clang::tooling::CompileCommand> getAllCompileCommands() const override { return m_database->getAllCompileCommands(); }
+
+private:
+    std::unique_ptr<clang::tooling::CompilationDatabase> m_database;
+    mutable std::once_flag m_interpolated_once;
+    mutable std::unique_ptr<clang::tooling::CompilationDatabase> m_interpolated;
+};
+
+class IndexWriterTrait {
+public:
+    using key_type = llvm::StringRef;
+    using key_type_ref = llvm::StringRef;
+    using data_type = std::vector<clang::tooling::CompileCommand>;
+    using data_type_ref = data_type const&;
+    using hash_value_type = jakt_bindgen::hash_value_type;
+    using offset_type = jakt_bindgen::offset_type;
+
+    static hash_value_type ComputeHash(key_type_ref key) { return hashPath(key); }
+
+    std::pair<offset_type, offset_type> EmitKeyDataLength(llvm::raw_ostream& out, key_type_ref key, data_type_ref commands)
+    {
+        offset_type data_length = sizeof(offset_type);
+        for (auto const& command : commands) {
+            data_length += encodedLength(command.Directory) + encodedLength(command.Filename) + encodedLength(command.Output);
+            data_length += sizeof(offset_type);
+            for (auto const& argument : command.CommandLine)
+                data_length += encodedLength(argument);
+        }
+
+        llvm::support::endian::Writer writer(out, llvm::support::little);
+        writer.write<offset_type>(key.size());
+        writer.write<offset_type>(data_length);
+        return { key.size(), data_length };
+    }
+
+    void EmitKey(llvm::raw_ostream& out, key_type_ref key, offset_type)
+    {
+        out << key;
+    }
+
+    void EmitData(llvm::raw_ostream& out, key_type_ref, data_type_ref commands, offset_type)
+    {
+        llvm::support::endian::Writer writer(out, llvm::support::little);
+        writer.write<offset_type>(commands.size());
+        for (auto const& command : commands) {
+            writeString(writer, command.Directory);
+            writeString(writer, command.Filename);
+            writeString(writer, command.Output);
+            writer.write<offset_type>(command.CommandLine.size());
+            for (auto const& argument : command.CommandLine)
+                writeString(writer, argument);
+        }
+    }
+};
+
+}
+
+class CompilationDatabaseIndex::LookupTrait {
+public:
+    using internal_key_type = llvm::StringRef;
+    using external_key_type = llvm::StringRef;
+    using data_type = std::vector<clang::tooling::CompileCommand>;
+    using hash_value_type = jakt_bindgen::hash_value_type;
+    using offset_type = jakt_bindgen::offset_type;
+
+    static bool EqualKey(internal_key_type lhs, internal_key_type rhs) { return lhs == rhs; }
+    static hash_value_type ComputeHash(internal_key_type key) { return hashPath(key); }
+    static internal_key_type GetInternalKey(external_key_type key) { return key; }
+    static external_key_type GetExternalKey(internal_key_type key) { return key; }
+
+    static std::pair<offset_type, offset_type> ReadKeyDataLength(unsigned char const*& data)
+    {
+        using namespace llvm::support;
+        auto key_length = endian::readNext<offset_type, little, unaligned>(data);
+        auto data_length = endian::readNext<offset_type, little, unaligned>(data);
+        return { key_length, data_length };
+    }
+
+    static internal_key_type ReadKey(unsigned char const* data, offset_type length)
+    {
+        return llvm::StringRef(reinterpret_cast<char const*>(data), length);
+    }
+
+    static data_type ReadData(internal_key_type, unsigned char const* data, offset_type)
+    {
+        using namespace llvm::support;
+        data_type commands(endian::readNext<offset_type, little, unaligned>(data));
+        for (auto& command : commands) {
+            command.Directory = readString(data).str();
+            command.Filename = readString(data).str();
+            command.Output = readString(data).str();
+            command.CommandLine.resize(endian::readNext<offset_type, little, unaligned>(data));
+            for (auto& argument : command.CommandLine)
+                argument = readString(data).str();
+        }
+        return commands;
+    }
+};
+
+CompilationDatabaseIndex::CompilationDatabaseIndex(std::unique_ptr<llvm::MemoryBuffer> buffer, std::unique_ptr<Table> table)
+    : m_buffer(std::move(buffer))
+    , m_table(std::move(table))
+{
+}
+
+CompilationDatabaseIndex::~CompilationDatabaseIndex()
+{
+}
+
+std::unique_ptr<clang::tooling::CompilationDatabase> CompilationDatabaseIndex::load(llvm::StringRef build_directory, llvm::StringRef index_path, std::string& error_message)
+{
+    llvm::SmallString<256> json_path(build_directory);
+    llvm::sys::path::append(json_path, "compile_commands.json");
+    llvm::sys::fs::make_absolute(json_path);
+
+    auto index = open(json_path.str().str(), index_path.str());
+    if (!index) {
+        if (!build(json_path.str().str(), index_path.str(), error_message))
+            return nullptr;
+        index = open(json_path.str().str(), index_path.str());
+        if (!index) {
+            error_message = ("Can't read the compilation database index " + index_path + ", or " + json_path + " changed while indexing it").str();
+            return nullptr;
+        }
+    }
+
+    return clang::tooling::inferTargetAndDriverMode(std::make_unique<LazilyInterpolatingDatabase>(
+        clang::tooling::expandResponseFiles(std::move(index), llvm::vfs::getRealFileSystem())));
+}
+
+std::unique_ptr<CompilationDatabaseIndex> CompilationDatabaseIndex::open(std::string const& json_path, std::string const& index_path)
+{
+    llvm::TimeTraceScope scope("OpenCompilationDatabaseIndex");
+
+    // Mapped rather than read for any index big enough for it to matter. Only the pages holding the entries asked for are touched.
+    auto buffer = llvm::MemoryBuffer::getFile(index_path, /* IsText = */ false, /* RequiresNullTerminator = */ false);
+    if (!buffer)
+        return nullptr;
+
+    auto contents = buffer.get()->getBuffer();
+    if (contents.size() < s_fixed_header_size || !contents.startswith(s_magic))
+        return nullptr;
+
+    using namespace llvm::support;
+    auto const* base = reinterpret_cast<unsigned char const*>(contents.data());
+    auto const* cursor = base + s_magic.size();
+    if (endian::readNext<uint32_t, little, unaligned>(cursor) != s_index_version)
+        return nullptr;
+    auto payload_offset = endian::readNext<offset_type, little, unaligned>(cursor);
+    auto table_offset = endian::readNext<offset_type, little, unaligned>(cursor);
+
+    FileFingerprint fingerprint;
+    fingerprint.size = endian::readNext<uint64_t, little, unaligned>(cursor);
+    fingerprint.modification_time = endian::readNext<int64_t, little, unaligned>(cursor);
+    fingerprint.content_hash = endian::readNext<uint64_t, little, unaligned>(cursor);
+    auto path_length = endian::readNext<offset_type, little, unaligned>(cursor);
+    if (s_fixed_header_size + path_length > payload_offset || payload_offset > table_offset || table_offset >= contents.size() || table_offset % alignof(offset_type) != 0)
+        return nullptr;
+    fingerprint.path = std::string(reinterpret_cast<char const*>(cursor), path_length);
+
+    if (fingerprint.path != json_path || !fingerprint.matchesFileOnDisk())
+        return nullptr;
+
+    auto table = std::unique_ptr<Table>(Table::Create(base + table_offset, base + payload_offset, base));
+    return std::unique_ptr<CompilationDatabaseIndex>(new CompilationDatabaseIndex(std::move(buffer.get()), std::move(table)));
+}
+
+bool CompilationDatabaseIndex::build(std::string const& json_path, std::string const& index_path, std::string& error_message)
+{
+    llvm::TimeTraceScope scope("IndexCompilationDatabase");
+
+    // Taken before parsing, so that the index is stale rather than silently out of date if the JSON changes in the meantime.
+    auto fingerprint = FileFingerprint::create(json_path);
+    if (!fingerprint.has_value()) {
+        error_message = "Can't read " + json_path;
+        return false;
+    }
+
+    auto json = clang::tooling::JSONCompilationDatabase::loadFromFile(json_path, error_message, clang::tooling::JSONCommandLineSyntax::AutoDetect);
+    if (!json)
+        return false;
+
+    llvm::StringMap<std::vector<clang::tooling::CompileCommand>> commands_by_file;
+    for (auto& command : json->getAllCompileCommands()) {
+        auto path = realPath(normalizedPath(command.Filename, command.Directory));
+        commands_by_file[path].push_back(std::move(command));
+    }
+
+    llvm::OnDiskChainedHashTableGenerator<IndexWriterTrait> generator;
+    for (auto const& entry : commands_by_file)
+        generator.insert(entry.getKey(), entry.getValue());
+
+    llvm::SmallString<0> contents;
+    llvm::raw_svector_ostream os(contents);
+    llvm::support::endian::Writer writer(os, llvm::support::little);
+    os << s_magic;
+    writer.write<uint32_t>(s_index_version);
+    // The payload and table offsets, filled in below.
+    writer.write<offset_type>(0);
+    writer.write<offset_type>(0);
+    writer.write<uint64_t>(fingerprint->size);
+    writer.write<int64_t>(fingerprint->modification_time);
+    writer.write<uint64_t>(fingerprint->content_hash);
+    writeString(writer, fingerprint->path);
+
+    offset_type payload_offset = contents.size();
+    offset_type table_offset = generator.Emit(os);
+    llvm::support::endian::write32le(contents.data() + s_payload_offset_position, payload_offset);
+    llvm::support::endian::write32le(contents.data() + s_payload_offset_position + sizeof(offset_type), table_offset);
+
+    // Other runs may have the old index mapped, so it's replaced rather than overwritten.
+    if (auto error = llvm::writeFileAtomically(index_path + "-%%%%%%%%.tmp", index_path, contents)) {
+        error_message = "Can't write compilation database index " + index_path + ": " + llvm::toString(std::move(error));
+        return false;
+    }
+    return true;
+}
+
+std::vector<clang::tooling::CompileCommand> CompilationDatabaseIndex::getCompileCommands(llvm::StringRef file_path) const
+{
+    auto path = normalizedPath(file_path, {});
+    if (auto it = m_table->find(path); it != m_table->end())
+        return *it;
+    if (auto it = m_table->find(realPath(std::move(path))); it != m_table->end())
+        return *it;
+    return {};
+}
+
+std::vector<std::string> CompilationDatabaseIndex::getAllFiles() const
+{
+    std::vector<std::string> files;
+    files.reserve(m_table->getNumEntries());
+    for (auto file : m_table->keys())
+        files.push_back(file.str());
+    return files;
+}
+
+std::vector<clang::tooling::CompileCommand> CompilationDatabaseIndex::getAllCompileCommands() const
+{
+    std::vector<clang::tooling::CompileCommand> all_commands;
+    for (auto commands : m_table->data())
+        all_commands.insert(all_commands.end(), std::make_move_iterator(commands.begin()), std::make_move_iterator(commands.end()));
+    return all_commands;
+}
+
+}
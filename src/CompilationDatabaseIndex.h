@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <clang/Tooling/CompilationDatabase.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/OnDiskHashTable.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+// A compile_commands.json converted to an on-disk hash table keyed by file path.
+// Loading it only maps the file, and a lookup only decodes the commands of the file asked for, so a run that binds a
+// handful of headers doesn't pay for parsing every command of the build. The index records the fingerprint of the JSON it
+// was built from, and is rebuilt (once, by whichever run notices first) when the JSON changes.
+class CompilationDatabaseIndex : public clang::tooling::CompilationDatabase {
+public:
+    // Opens the index at index_path of build_directory/compile_commands.json, building it first if it's missing or stale.
+    // The result is wrapped like clang's own JSON database plugin does, so headers get commands inferred from a nearby source file.
+    // Inferring commands needs every file of the database though, so it's only set up once a file without commands is looked up.
+    static std::unique_ptr<clang::tooling::CompilationDatabase> load(llvm::StringRef build_directory, llvm::StringRef index_path, std::string& error_message);
+
+    ~CompilationDatabaseIndex() override;
+
+    std::vector<clang::tooling::CompileCommand> getCompileCommands(llvm::StringRef file_path) const override;
+    std::vector<std::string> getAllFiles() const override;
+    std::vector<clang::tooling::CompileCommand> getAllCompileCommands() const override;
+
+private:
+    class LookupTrait;
+    using Table = llvm::OnDiskIterableChainedHashTable<LookupTrait>;
+
+    CompilationDatabaseIndex(std::unique_ptr<llvm::MemoryBuffer> buffer, std::unique_ptr<Table> table);
+
+    static std::unique_ptr<CompilationDatabaseIndex> open(std::string const& json_path, std::string const& index_path);
+    static bool build(std::string const& json_path, std::string const& index_path, std::string& error_message);
+
+    std::unique_ptr<llvm::MemoryBuffer> m_buffer;
+    std::unique_ptr<Table> m_table;
+};
+
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "CompileCommands.h"
+#include "CompilationDatabaseIndex.h"
+#include <algorithm>
+#include <clang/Tooling/CommonOptionsParser.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/TimeProfiler.h>
+
+namespace jakt_bindgen {
+
+std::vector<std::string> removeInputFile(std::vector<std::string> const& command_line, llvm::StringRef filename)
+{
+    std::vector<std::string> result;
+    result.reserve(command_line.size());
+    for (auto const& argument : command_line) {
+        if (argument != filename)
+            result.push_back(argument);
+    }
+    return result;
+}
+
+std::vector<std::string> flagsForOtherInput(clang::tooling::CompileCommand const& command)
+{
+    auto adjuster = clang::tooling::combineAdjusters(clang::tooling::getClangStripOutputAdjuster(),
+        clang::tooling::getClangStripDependencyFileAdjuster());
+    return removeInputFile(adjuster(command.CommandLine, command.Filename), command.Filename);
+}
+
+clang::tooling::ArgumentsAdjuster getReplaceInputFileAdjuster(std::string replacement)
+{
+    return [replacement = std::move(replacement)](clang::tooling::CommandLineArguments const& arguments, llvm::StringRef filename) {
+        clang::tooling::CommandLineArguments result(arguments);
+        std::replace(result.begin(), result.end(), filename.str(), replacement);
+        return result;
+    };
+}
+
+std::unique_ptr<clang::tooling::CompilationDatabase> loadCompilationDatabase(CompilationDatabaseOptions const& options, std::vector<std::string> const& source_paths, std::string& error_message)
+{
+    llvm::TimeTraceScope scope("LoadCompilationDatabase");
+
+    std::unique_ptr<clang::tooling::CompilationDatabase> compilations;
+    if (!options.index_path.empty()) {
+        if (options.build_path.empty())
+            error_message = "An index of the compilation database needs the build path holding compile_commands.json.\n";
+        else
+            compilations = CompilationDatabaseIndex::load(options.build_path, options.index_path, error_message);
+    } else if (!options.build_path.empty()) {
+        compilations = clang::tooling::CompilationDatabase::autoDetectFromDirectory(options.build_path, error_message);
+    } else if (!source_paths.empty()) {
+        compilations = clang::tooling::CompilationDatabase::autoDetectFromSource(source_paths.front(), error_message);
+    } else if (!options.search_directory.empty()) {
+        for (llvm::StringRef directory = options.search_directory; !directory.empty() && !compilations; directory = llvm::sys::path::parent_path(directory))
+            compilations = clang::tooling::CompilationDatabase::autoDetectFromDirectory(directory, error_message);
+        if (!compilations)
+            error_message = "No compilation database found in " + options.search_directory + " or any of its parents.\n";
+    } else {
+        error_message = "No build path given, and no header to find one from.\n";
+    }
+
+    if (!compilations)
+        return nullptr;
+    return withExtraArguments(std::move(compilations), options);
+}
+
+std::unique_ptr<clang::tooling::CompilationDatabase> withExtraArguments(std::unique_ptr<clang::tooling::CompilationDatabase> compilations, CompilationDatabaseOptions const& options)
+{
+    auto adjusting_compilations = std::make_unique<clang::tooling::ArgumentsAdjustingCompilations>(std::move(compilations));
+    adjusting_compilations->appendArgumentsAdjuster(clang::tooling::combineAdjusters(
+        clang::tooling::getInsertArgumentAdjuster(options.extra_args_before, clang::tooling::ArgumentInsertPosition::BEGIN),
+        clang::tooling::getInsertArgumentAdjuster(options.extra_args, clang::tooling::ArgumentInsertPosition::END)));
+    return adjusting_compilations;
+}
+
+}
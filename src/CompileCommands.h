@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <clang/Tooling/ArgumentsAdjusters.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <llvm/ADT/StringRef.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+// Removes every occurrence of the input file from a compile command line.
+std::vector<std::string> removeInputFile(std::vector<std::string> const& command_line, llvm::StringRef filename);
+
+// Returns the flags of a compile command with its input and output files stripped, so that they can be used
+// to compile a different file (e.g. a synthesized one) exactly like the original.
+// The first element is still the compiler executable.
+std::vector<std::string> flagsForOtherInput(clang::tooling::CompileCommand const& command);
+
+// Compiles `replacement` in place of the input file of each command, with otherwise identical flags.
+clang::tooling::ArgumentsAdjuster getReplaceInputFileAdjuster(std::string replacement);
+
+struct CompilationDatabaseOptions {
+    // Directory holding compile_commands.json. When empty, it's searched for in the parents of the first source.
+    std::string build_path;
+
+    // Searched, along with its parents, when there's neither a build path nor a source, e.g. when discovering headers.
+    std::string search_directory;
+
+    // Index of the compilation database in build_path, built on first use (see CompilationDatabaseIndex). Needs a build_path.
+    std::string index_path;
+
+    std::vector<std::string> extra_args_before;
+    std::vector<std::string> extra_args;
+};
+
+// Loads a compilation database the way CommonOptionsParser does, with the extra arguments added to every command.
+// Returns null and sets error_message if there's none to be found.
+std::unique_ptr<clang::tooling::CompilationDatabase> loadCompilationDatabase(CompilationDatabaseOptions const& options, std::vector<std::string> const& source_paths, std::string& error_message);
+
+// Adds the extra arguments of the options to every command of a database that was loaded otherwise.
+std::unique_ptr<clang::tooling::CompilationDatabase> withExtraArguments(std::unique_ptr<clang::tooling::CompilationDatabase> compilations, CompilationDatabaseOptions const& options);
+
+}
@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Console.h"
+
+namespace jakt_bindgen {
+
+std::mutex& consoleMutex()
+{
+    static std::mutex s_console_mutex;
+    return s_console_mutex;
+}
+
+}
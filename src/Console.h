@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <mutex>
+
+namespace jakt_bindgen {
+
+// Headers are processed in parallel, and llvm::outs()/llvm::errs() aren't thread-safe.
+// Anything that may print from a worker or a generation pool thread holds this lock while it does.
+std::mutex& consoleMutex();
+
+}
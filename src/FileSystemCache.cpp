@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "FileSystemCache.h"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Path.h>
+#include <mutex>
+
+namespace jakt_bindgen {
+
+// Anything bigger is most likely a PCH or an AST, which clang maps instead of reading, and which we'd rather not pin in memory.
+static constexpr uint64_t s_max_cached_file_size = 4 * 1024 * 1024;
+
+namespace {
+
+// A file whose contents are owned by the cache, which outlives every TU that reads it.
+class CachedFile : public llvm::vfs::File {
+public:
+    CachedFile(llvm::vfs::Status status, llvm::MemoryBuffer const& contents)
+        : m_status(std::move(status))
+        , m_contents(contents)
+    {
+    }
+
+    llvm::ErrorOr<llvm::vfs::Status> status() override { return m_status; }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> getBuffer(llvm::Twine const& name, int64_t, bool requires_null_terminator, bool) override
+    {
+        // The cached buffer is null terminated, so a reference to it is good either way.
+        return llvm::MemoryBuffer::getMemBuffer(m_contents.getBuffer(), name.str(), requires_null_terminator);
+    }
+
+    std::error_code close() override { return {}; }
+
+private:
+    llvm::vfs::Status m_status;
+    llvm::MemoryBuffer const& m_contents;
+};
+
+}
+
+class CachingFileSystem : public llvm::vfs::ProxyFileSystem {
+public:
+    CachingFileSystem(std::shared_ptr<FileSystemCache> cache, llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying)
+        : ProxyFileSystem(std::move(underlying))
+        , m_cache(std::move(cache))
+    {
+    }
+
+    llvm::ErrorOr<llvm::vfs::Status> status(llvm::Twine const& path) override
+    {
+        llvm::SmallString<256> absolute_path;
+        path.toVector(absolute_path);
+        if (makeAbsolute(absolute_path))
+            return ProxyFileSystem::status(path);
+
+        if (auto cached = m_cache->findStatus(absolute_path)) {
+            ++m_cache->m_status_hits;
+            return withName(cached.value(), path);
+        }
+        ++m_cache->m_status_misses;
+        return withName(m_cache->addStatus(absolute_path, ProxyFileSystem::status(absolute_path)), path);
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(llvm::Twine const& path) override
+    {
+        llvm::SmallString<256> absolute_path;
+        path.toVector(absolute_path);
+        if (makeAbsolute(absolute_path))
+            return ProxyFileSystem::openFileForRead(path);
+
+        auto status = this->status(absolute_path);
+        if (!status)
+            return status.getError();
+        if (status->getSize() > s_max_cached_file_size) {
+            m_cache->addReadFile(absolute_path, { status.get(), nullptr });
+            return ProxyFileSystem::openFileForRead(path);
+        }
+
+        if (auto const* contents = m_cache->findContents(absolute_path)) {
+            ++m_cache->m_read_hits;
+            return std::make_unique<CachedFile>(llvm::vfs::Status::copyWithNewName(status.get(), path), *contents);
+        }
+        ++m_cache->m_read_misses;
+
+        // Read outside of the cache's lock. If another thread got there first, its copy is used instead.
+        auto file = ProxyFileSystem::openFileForRead(absolute_path);
+        if (!file)
+            return file.getError();
+        auto contents = file.get()->getBuffer(absolute_path, status->getSize(), /* RequiresNullTerminator = */ true, /* IsVolatile = */ false);
+        if (!contents)
+            return contents.getError();
+        auto const& cached_contents = m_cache->addContents(absolute_path, std::move(contents.get()));
+        m_cache->addReadFile(absolute_path, { status.get(), &cached_contents });
+        return std::make_unique<CachedFile>(llvm::vfs::Status::copyWithNewName(status.get(), path), cached_contents);
+    }
+
+private:
+    // Like the real file system, report the name a file was asked for by, not the one it's cached under.
+    static llvm::ErrorOr<llvm::vfs::Status> withName(llvm::ErrorOr<llvm::vfs::Status> const& status, llvm::Twine const& name)
+    {
+        if (!status)
+            return status.getError();
+        return llvm::vfs::Status::copyWithNewName(status.get(), name);
+    }
+
+    std::shared_ptr<FileSystemCache> m_cache;
+};
+
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FileSystemCache::wrap(std::shared_ptr<FileSystemCache> cache, llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying)
+{
+    return llvm::makeIntrusiveRefCnt<CachingFileSystem>(std::move(cache), std::move(underlying));
+}
+
+FileSystemCache::Counters FileSystemCache::counters() const
+{
+    return Counters {
+        .status_hits = m_status_hits,
+        .status_misses = m_status_misses,
+        .read_hits = m_read_hits,
+        .read_misses = m_read_misses,
+    };
+}
+
+std::optional<llvm::ErrorOr<llvm::vfs::Status>> FileSystemCache::findStatus(llvm::StringRef path) const
+{
+    std::shared_lock lock(m_lock);
+    auto it = m_statuses.find(path);
+    if (it == m_statuses.end())
+        return {};
+    return it->getValue();
+}
+
+llvm::ErrorOr<llvm::vfs::Status> FileSystemCache::addStatus(llvm::StringRef path, llvm::ErrorOr<llvm::vfs::Status> status)
+{
+    std::unique_lock lock(m_lock);
+    return m_statuses.try_emplace(path, std::move(status)).first->getValue();
+}
+
+llvm::MemoryBuffer const* FileSystemCache::findContents(llvm::StringRef path) const
+{
+    std::shared_lock lock(m_lock);
+    auto it = m_contents.find(path);
+    if (it == m_contents.end())
+        return nullptr;
+    return it->getValue().get();
+}
+
+llvm::MemoryBuffer const& FileSystemCache::addContents(llvm::StringRef path, std::unique_ptr<llvm::MemoryBuffer> contents)
+{
+    std::unique_lock lock(m_lock);
+    return *m_contents.try_emplace(path, std::move(contents)).first->getValue();
+}
+
+std::optional<FileSystemCache::ReadFile> FileSystemCache::readFile(llvm::StringRef path) const
+{
+    std::shared_lock lock(m_lock);
+    auto it = m_read_files.find(path);
+    if (it == m_read_files.end())
+        return {};
+    return it->getValue();
+}
+
+void FileSystemCache::addReadFile(llvm::StringRef path, ReadFile read_file)
+{
+    llvm::SmallString<256> normalized_path(path);
+    llvm::sys::path::remove_dots(normalized_path, /* remove_dot_dot */ true);
+
+    // Every TU of the run reads the same contents, so the first read stands for all of them.
+    std::unique_lock lock(m_lock);
+    m_read_files.try_emplace(normalized_path, std::move(read_file));
+}
+
+}
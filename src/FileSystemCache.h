@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/ErrorOr.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+
+namespace jakt_bindgen {
+
+// Stat results and file contents shared by every translation unit of a run, keyed by absolute path.
+// Every header includes more or less the same AK and LibCore headers, so after the first TU nearly every stat
+// (including the misses while searching the include path) and every read is answered from memory.
+// Nothing is ever invalidated: the cache must not outlive the run, as files may change in between.
+class FileSystemCache {
+public:
+    struct Counters {
+        uint64_t status_hits { 0 };
+        uint64_t status_misses { 0 };
+        uint64_t read_hits { 0 };
+        uint64_t read_misses { 0 };
+    };
+
+    // A file system reading through this cache. Each has its own working directory, kept by `underlying`.
+    // Files bigger than a few MiB (e.g. a PCH) are read directly, only their status is cached.
+    static llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> wrap(std::shared_ptr<FileSystemCache>, llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying);
+
+    Counters counters() const;
+
+    // The status of a file and the contents the TUs of this run read, by the path with its dots removed (as dependency
+    // lists spell it). Files that were too big to be cached were read from disk directly, so their contents are unknown.
+    struct ReadFile {
+        llvm::vfs::Status status;
+        llvm::MemoryBuffer const* contents { nullptr };
+    };
+    std::optional<ReadFile> readFile(llvm::StringRef path) const;
+
+private:
+    friend class CachingFileSystem;
+
+    std::optional<llvm::ErrorOr<llvm::vfs::Status>> findStatus(llvm::StringRef path) const;
+    llvm::ErrorOr<llvm::vfs::Status> addStatus(llvm::StringRef path, llvm::ErrorOr<llvm::vfs::Status> status);
+
+    llvm::MemoryBuffer const* findContents(llvm::StringRef path) const;
+    llvm::MemoryBuffer const& addContents(llvm::StringRef path, std::unique_ptr<llvm::MemoryBuffer> contents);
+    void addReadFile(llvm::StringRef path, ReadFile read_file);
+
+    mutable std::shared_mutex m_lock;
+    llvm::StringMap<llvm::ErrorOr<llvm::vfs::Status>> m_statuses;
+    llvm::StringMap<std::unique_ptr<llvm::MemoryBuffer>> m_contents;
+    llvm::StringMap<ReadFile> m_read_files;
+
+    mutable std::atomic<uint64_t> m_status_hits { 0 };
+    mutable std::atomic<uint64_t> m_status_misses { 0 };
+    mutable std::atomic<uint64_t> m_read_hits { 0 };
+    mutable std::atomic<uint64_t> m_read_misses { 0 };
+};
+
+}
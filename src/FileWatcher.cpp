@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "FileWatcher.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <thread>
+
+#ifdef __linux__
+#    include <poll.h>
+#    include <sys/inotify.h>
+#    include <unistd.h>
+#endif
+
+namespace jakt_bindgen {
+
+// How long to wait for more changes after the first one before reporting them.
+static constexpr int s_settle_time_ms = 100;
+
+// How often to stat every watched file when inotify isn't available.
+static constexpr auto s_poll_interval = std::chrono::milliseconds(500);
+
+static std::optional<llvm::sys::TimePoint<>> modificationTime(llvm::StringRef path)
+{
+    llvm::sys::fs::file_status status;
+    if (llvm::sys::fs::status(path, status))
+        return {};
+    return status.getLastModificationTime();
+}
+
+std::unique_ptr<FileWatcher> FileWatcher::create()
+{
+    std::unique_ptr<FileWatcher> watcher(new FileWatcher);
+#ifdef __linux__
+    watcher->m_inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (watcher->m_inotify_fd < 0)
+        llvm::errs() << "Can't initialize inotify: " << strerror(errno) << ". Polling for changes instead\n";
+#endif
+    return watcher;
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    if (m_inotify_fd >= 0)
+        close(m_inotify_fd);
+#endif
+}
+
+void FileWatcher::watch(std::vector<std::string> const& paths)
+{
+    m_watched_files.clear();
+    for (auto const& path : paths)
+        m_watched_files.insert(path);
+
+    if (m_inotify_fd < 0) {
+        llvm::StringMap<std::optional<llvm::sys::TimePoint<>>> modification_times;
+        for (auto const& path : paths)
+            modification_times[path] = modificationTime(path);
+        m_modification_times = std::move(modification_times);
+        return;
+    }
+
+#ifdef __linux__
+    llvm::StringSet<> directories;
+    for (auto const& path : paths)
+        directories.insert(llvm::sys::path::parent_path(path));
+
+    for (auto it = m_watched_directories.begin(); it != m_watched_directories.end();) {
+        auto current = it++;
+        if (directories.erase(current->second))
+            continue;
+        inotify_rm_watch(m_inotify_fd, current->first);
+        m_watched_directories.erase(current);
+    }
+
+    for (auto const& directory : directories) {
+        auto const directory_path = directory.getKey().str();
+        int watch_descriptor = inotify_add_watch(m_inotify_fd, directory_path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+        if (watch_descriptor < 0) {
+            llvm::errs() << "Can't watch " << directory_path << ": " << strerror(errno) << "\n";
+            continue;
+        }
+        m_watched_directories[watch_descriptor] = directory_path;
+    }
+#endif
+}
+
+std::optional<std::vector<std::string>> FileWatcher::waitForChanges()
+{
+    if (m_inotify_fd < 0)
+        return pollForChanges();
+
+    llvm::StringSet<> changed;
+#ifdef __linux__
+    alignas(inotify_event) char buffer[16 * 1024];
+
+    // Block for the first change, then keep draining events until none arrive for a little while.
+    int timeout_ms = -1;
+    for (;;) {
+        pollfd descriptor { m_inotify_fd, POLLIN, 0 };
+        int ready = poll(&descriptor, 1, timeout_ms);
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready < 0) {
+            llvm::errs() << "Can't wait for file changes: " << strerror(errno) << "\n";
+            return {};
+        }
+        if (ready == 0)
+            break;
+
+        auto length = read(m_inotify_fd, buffer, sizeof(buffer));
+        if (length < 0 && errno != EINTR) {
+            llvm::errs() << "Can't read file changes: " << strerror(errno) << "\n";
+            return {};
+        }
+        if (length <= 0)
+            continue;
+
+        for (char const* pointer = buffer; pointer < buffer + length;) {
+            auto const* event = reinterpret_cast<inotify_event const*>(pointer);
+            pointer += sizeof(inotify_event) + event->len;
+
+            auto directory = m_watched_directories.find(event->wd);
+            if (directory == m_watched_directories.end() || event->len == 0)
+                continue;
+
+            llvm::SmallString<256> path(directory->second);
+            llvm::sys::path::append(path, event->name);
+            if (m_watched_files.contains(path))
+                changed.insert(path);
+        }
+
+        if (!changed.empty())
+            timeout_ms = s_settle_time_ms;
+    }
+#endif
+
+    std::vector<std::string> result;
+    for (auto const& path : changed)
+        result.push_back(path.getKey().str());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<std::string> FileWatcher::pollForChanges()
+{
+    std::vector<std::string> changed;
+    while (changed.empty()) {
+        std::this_thread::sleep_for(s_poll_interval);
+        for (auto& entry : m_modification_times) {
+            auto current_modification_time = modificationTime(entry.getKey());
+            if (current_modification_time == entry.getValue())
+                continue;
+            entry.getValue() = current_modification_time;
+            changed.push_back(entry.getKey().str());
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    return changed;
+}
+
+}
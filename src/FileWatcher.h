@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/Chrono.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+// Waits for any of a set of files to change.
+// On Linux this uses inotify on the directories holding the files, so that editors that save by writing a new file
+// and renaming it over the old one are noticed as well. Elsewhere, the files are polled for changes to their mtime.
+class FileWatcher {
+public:
+    static std::unique_ptr<FileWatcher> create();
+    ~FileWatcher();
+
+    // Replaces the set of watched files. Paths are compared as given, so they should be absolute and normalized.
+    void watch(std::vector<std::string> const& paths);
+
+    // Blocks until at least one watched file was modified, created or removed, then waits for the burst of
+    // changes an editor or build makes to settle. Returns the paths of every watched file that changed,
+    // or nothing if the changes can't be waited for anymore (after saying why).
+    std::optional<std::vector<std::string>> waitForChanges();
+
+private:
+    FileWatcher() = default;
+
+    std::vector<std::string> pollForChanges();
+
+    llvm::StringSet<> m_watched_files;
+
+    // inotify watch descriptor -> watched directory
+    int m_inotify_fd { -1 };
+    llvm::DenseMap<int, std::string> m_watched_directories;
+
+    // Last seen modification time of each watched file, or nothing if it didn't exist. Only used when polling.
+    llvm::StringMap<std::optional<llvm::sys::TimePoint<>>> m_modification_times;
+};
+
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "IncludeCollector.h"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Path.h>
+
+namespace jakt_bindgen {
+
+std::vector<std::string> IncludeCollector::absoluteDependencies(clang::FileManager const& file_manager) const
+{
+    std::vector<std::string> dependencies;
+    dependencies.reserve(getDependencies().size());
+    for (auto const& dependency : getDependencies()) {
+        llvm::SmallString<256> path(dependency);
+        file_manager.makeAbsolutePath(path);
+        llvm::sys::path::remove_dots(path, /* remove_dot_dot */ true);
+        dependencies.emplace_back(path.str());
+    }
+    return dependencies;
+}
+
+}
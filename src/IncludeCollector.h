@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <clang/Basic/FileManager.h>
+#include <clang/Frontend/Utils.h>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+// Records the full include closure of a translation unit, system headers included, as AK and LibCore are
+// often included with angle brackets and a change to them can change the generated bindings.
+class IncludeCollector : public clang::DependencyCollector {
+public:
+    virtual bool needSystemDependencies() override { return true; }
+
+    // The collected dependencies made absolute against the working directory of the compile command.
+    std::vector<std::string> absoluteDependencies(clang::FileManager const& file_manager) const;
+};
+
+}
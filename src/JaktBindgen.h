@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+// The public interface of libjaktbindgen, for generating bindings in process instead of running jakt-bindgen:
+//
+//     std::string error;
+//     auto compilations = jakt_bindgen::loadCompilationDatabase({ .build_path = "Build" }, headers, error);
+//     jakt_bindgen::MemoryOutputSink output;
+//     jakt_bindgen::BindingRunner runner(*compilations, { .target_namespace = "GUI", .out_dir = "Bindings", .base_dir = "Userland/Libraries", .output = &output });
+//     int result = runner.run(headers);
+//     auto files = output.takeFiles();
+//
+// A runner keeps its caches, type map and thread pools around between calls to run().
+
+#include "BindingRunner.h"
+#include "CompileCommands.h"
+#include "OutputSink.h"
@@ -7,43 +7,58 @@
 #define DEBUG_TYPE "jakt-gen"
 #include <llvm/Support/Debug.h>
 
-#include "CXXClassListener.h"
 #include "JaktGenerator.h"
 
-#include <clang/AST/ASTContext.h>
-#include <clang/AST/CXXInheritance.h>
-#include <clang/AST/Decl.h>
-#include <clang/AST/DeclCXX.h>
-#include <clang/AST/DeclTemplate.h>
-#include <clang/AST/PrettyPrinter.h>
-#include <clang/AST/Type.h>
-#include <clang/ASTMatchers/ASTMatchers.h>
-#include <clang/Basic/LangOptions.h>
-#include <clang/Basic/Specifiers.h>
+#include <cassert>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
+#include <future>
 #include <string>
-#include <string_view>
+#include <vector>
 
 namespace jakt_bindgen {
 
-JaktGenerator::JaktGenerator(llvm::raw_ostream& out, CXXClassListener const& class_information)
+ALWAYS_ENABLED_STATISTIC(NumClassesEmitted, "Classes emitted");
+ALWAYS_ENABLED_STATISTIC(NumEnumsEmitted, "Enums emitted");
+ALWAYS_ENABLED_STATISTIC(NumMethodsEmitted, "Methods emitted");
+ALWAYS_ENABLED_STATISTIC(NumFactoriesEmitted, "try_create() factories emitted");
+ALWAYS_ENABLED_STATISTIC(NumMethodsSkippedReference, "Methods skipped for returning a reference");
+ALWAYS_ENABLED_STATISTIC(NumMethodsSkippedTemplate, "Method templates skipped");
+ALWAYS_ENABLED_STATISTIC(NumTypesRewritten, "Types rewritten through the type map");
+ALWAYS_ENABLED_STATISTIC(NumTypesUnmapped, "Types spelled as in C++ for lack of a mapping");
+ALWAYS_ENABLED_STATISTIC(NumNonTypeArguments, "Non-type template arguments dropped");
+ALWAYS_ENABLED_STATISTIC(NumTypeSpellingsReused, "Type spellings reused within a header");
+
+// Headers with fewer top level tags than twice this are rendered on the calling thread.
+static constexpr size_t s_min_tags_per_task = 4;
+
+JaktGenerator::JaktGenerator(llvm::raw_ostream& out, ApiHeader const& header, TypeMap const& type_map)
     : m_out(out)
-    , m_class_information(class_information)
-    , m_printing_policy(clang::LangOptions {})
+    , m_header(header)
+    , m_type_map(type_map)
+    , m_imports(&header.imports)
 {
-    // FIXME: Get the language options from higher up in the stack. The SourceFileHandler can probably get one from the clang::CompilerInstance
-    m_printing_policy.adjustForCPlusPlus();
 }
 
-void JaktGenerator::generate(std::string const& header_path)
+void JaktGenerator::generate(llvm::ThreadPool* pool)
 {
     printImportStatements();
 
-    printImportExternBegin(header_path);
+    printImportExternBegin(m_header.header_path);
 
-    printNamespaceBegin(llvm::cast<clang::NamespaceDecl>(m_class_information.tag_decls()[0]->getEnclosingNamespaceContext()));
-    for (clang::TagDecl const* tag_decl : m_class_information.tag_decls()) {
-        printTagDecl(tag_decl);
+    printNamespaceBegin(m_header.namespace_name);
+    if (pool && pool->getThreadCount() > 1 && m_header.tags.size() >= s_min_tags_per_task * 2) {
+        printTagsConcurrently(*pool);
+    } else {
+        for (ApiTag const& tag : m_header.tags) {
+            printTag(tag);
+        }
     }
     printNamespaceEnd();
 
@@ -52,9 +67,9 @@ void JaktGenerator::generate(std::string const& header_path)
 
 void JaktGenerator::printImportStatements()
 {
-    for (auto const* klass : m_class_information.imports()) {
-        m_out << "import " << llvm::cast<clang::NamespaceDecl>(klass->getEnclosingNamespaceContext())->getQualifiedNameAsString();
-        m_out << " { " << klass->getName() << " }\n";
+    for (auto const& import : *m_imports) {
+        m_out << "import " << import.namespace_name;
+        m_out << " { " << import.name << " }\n";
     }
 }
 
@@ -68,9 +83,9 @@ void JaktGenerator::printImportExternEnd()
     m_out << "} // import\n";
 }
 
-void JaktGenerator::printNamespaceBegin(clang::NamespaceDecl const* ns)
+void JaktGenerator::printNamespaceBegin(std::string const& ns)
 {
-    m_out << "namespace " << ns->getQualifiedNameAsString() << " {\n";
+    m_out << "namespace " << ns << " {\n";
 }
 
 void JaktGenerator::printNamespaceEnd()
@@ -78,424 +93,394 @@ void JaktGenerator::printNamespaceEnd()
     m_out << "} // namespace\n";
 }
 
-void JaktGenerator::printTagDecl(clang::TagDecl const* tag_declaration)
+void JaktGenerator::printTagsConcurrently(llvm::ThreadPool& pool)
 {
-    if (auto const* klass = llvm::dyn_cast<clang::CXXRecordDecl>(tag_declaration)) {
-        printClass(klass);
-    } else {
-        assert(llvm::isa<clang::EnumDecl>(tag_declaration));
-        printEnumeration(llvm::cast<clang::EnumDecl>(tag_declaration));
+    // A few tasks per thread evens out classes of very different sizes, without making the tasks too small to be worth it.
+    auto const& tags = m_header.tags;
+    auto task_count = std::min<size_t>(tags.size() / s_min_tags_per_task, pool.getThreadCount() * 4);
+    auto tags_per_task = (tags.size() + task_count - 1) / task_count;
+
+    struct RenderedTags {
+        std::string text;
+        std::vector<std::string> unsupported_templates;
+    };
+    std::vector<std::shared_future<RenderedTags>> rendered_tags;
+    for (size_t begin = 0; begin < tags.size(); begin += tags_per_task) {
+        auto chunk = llvm::makeArrayRef(tags).slice(begin, std::min(tags_per_task, tags.size() - begin));
+        rendered_tags.push_back(pool.async([this, chunk] {
+            RenderedTags rendered;
+            llvm::raw_string_ostream os(rendered.text);
+            // Each task spells types with its own memo, so nothing is shared between threads but the model.
+            JaktGenerator generator(os, m_header, m_type_map);
+            generator.m_indentation_level = m_indentation_level;
+            for (ApiTag const& tag : chunk)
+                generator.printTag(tag);
+            os.flush();
+            rendered.unsupported_templates = std::move(generator.m_unsupported_templates);
+            return rendered;
+        }));
+    }
+
+    for (auto const& rendered : rendered_tags) {
+        m_out << rendered.get().text;
+        for (auto const& spelling : rendered.get().unsupported_templates)
+            noteUnsupportedTemplate(spelling);
     }
 }
 
-void JaktGenerator::printClass(clang::CXXRecordDecl const* class_definition)
+void JaktGenerator::noteUnsupportedTemplate(llvm::StringRef spelling)
 {
-    using namespace clang::ast_matchers;
-    if (!class_definition->isCompleteDefinition()) {
-        // Skip incomplete types, i.e. forward declared in the header.
-        return;
-    }
-    if (class_definition->isUnion()) {
-        // Can't represent unions
-        return;
+    // Chunks rendered concurrently each see the same templates, so the list is deduplicated per header.
+    if (llvm::find(m_unsupported_templates, spelling) == m_unsupported_templates.end())
+        m_unsupported_templates.push_back(spelling.str());
+}
+
+void JaktGenerator::printTag(ApiTag const& tag)
+{
+    if (tag.class_.has_value()) {
+        printClass(tag.class_.value());
+    } else {
+        assert(tag.enum_.has_value());
+        printEnumeration(tag.enum_.value());
     }
+}
+
+void JaktGenerator::printClass(ApiClass const& klass)
+{
+    ++NumClassesEmitted;
 
     // extern struct | class <name> : <base(s)>
-    printClassDeclaration(class_definition);
+    printClassDeclaration(klass);
     m_out << " {\n";
     {
         IndentationIncreaser indent(m_indentation_level);
-        printClassMethods(class_definition);
-
-        // FIXME: Is there a way we can keep all the matching in the class listener?
-        auto nested_decls_matcher = traverse(clang::TK_IgnoreUnlessSpelledInSource,
-            tagDecl(decl().bind("nested-tag-decl"),
-                isExpansionInMainFile(),
-                hasParent(cxxRecordDecl(hasName(class_definition->getName())))));
-        auto nested_decls = match(nested_decls_matcher, *const_cast<clang::ASTContext*>(m_context));
-        for (auto const& node : nested_decls) {
-            if (auto const* tag_decl = node.getNodeAs<clang::TagDecl>("nested-tag-decl")) {
-                printTagDecl(tag_decl);
-            } else {
-                assert(false && "Malformed matcher!");
-            }
-        }
+        printClassMethods(klass);
+
+        for (ApiTag const& tag : klass.nested_tags)
+            printTag(tag);
     }
 
     printIndentation();
     m_out << "}\n";
 }
 
-static bool hasBaseNamed(clang::CXXRecordDecl const* class_definition, std::string_view base_name)
-{
-    clang::CXXBasePaths Paths;
-    Paths.setOrigin(class_definition);
-
-    return class_definition->lookupInBases([&base_name](clang::CXXBaseSpecifier const* base, clang::CXXBasePath&) -> bool {
-        auto record_type = base->getType()->getAs<clang::RecordType>();
-        if (!record_type)
-            return false;
-
-        auto name = llvm::cast<clang::CXXRecordDecl>(record_type->getDecl()->getDefinition())->getQualifiedNameAsString();
-        return name == base_name;
-    },
-        Paths, true);
-}
-
-bool JaktGenerator::isErrorOr(clang::QualType const& type) const
+bool JaktGenerator::isErrorOr(ApiTypeIndex type) const
 {
-    return getTemplateParameterIfMatches(type, "AK::ErrorOr").has_value();
+    auto const* mapping = templateMappingOf(typeAt(type));
+    return mapping && mapping->rule == TemplateMapping::Rule::ErrorOr;
 }
 
-std::optional<clang::QualType> JaktGenerator::getTemplateParameterIfMatches(clang::QualType const& type, llvm::StringRef template_name, unsigned int index) const
+std::optional<ApiTypeIndex> JaktGenerator::getTemplateArgument(ApiType const& type, unsigned int index) const
 {
-    assert(m_context != nullptr);
-    auto desugared_type = type.getDesugaredType(*m_context);
-    if (auto const* record_type = llvm::dyn_cast<clang::RecordType>(desugared_type)) {
-        if (record_type->getAsRecordDecl()->getQualifiedNameAsString() == template_name) {
-            if (auto const* t = llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(record_type->getAsRecordDecl()); t && t->getTemplateArgs().size() > index)
-                return t->getTemplateArgs()[index].getAsType();
-        }
-    }
-
-    return {};
+    if (index >= type.children.size() || type.children[index] == ApiType::non_type_argument)
+        return {};
+    return type.children[index];
 }
 
-void JaktGenerator::printClassDeclaration(clang::CXXRecordDecl const* class_definition)
+void JaktGenerator::printClassDeclaration(ApiClass const& klass)
 {
-    bool is_class = hasBaseNamed(class_definition, "AK::RefCountedBase");
-
     printIndentation();
-    m_out << "extern " << (is_class ? "class " : "struct ") << class_definition->getName() << " ";
+    m_out << "extern " << (klass.is_ref_counted ? "class " : "struct ") << klass.name << " ";
 
     bool first_base = true;
-    for (auto const& base : class_definition->bases()) {
-        if (base.isVirtual())
-            llvm::report_fatal_error("ERROR: Don't know how to handle virtual bases", false);
-        if (base.getAccessSpecifier() != clang::AccessSpecifier::AS_public)
-            llvm::report_fatal_error("ERROR: Don't know how to handle non-public bases", false);
-        clang::RecordType const* Ty = base.getType()->getAs<clang::RecordType>();
-        clang::CXXRecordDecl const* base_record = llvm::cast_or_null<clang::CXXRecordDecl>(Ty->getDecl()->getDefinition());
-        if (!base_record)
-            llvm::report_fatal_error("ERROR: Base class unusable", false);
-
-        auto base_class_name = base_record->getQualifiedNameAsString();
-        if (base_class_name == "AK::RefCounted" || base_class_name == "AK::Weakable")
+    for (llvm::StringRef base : klass.bases) {
+        if (m_type_map.isHiddenBase(base))
             continue;
-
         if (first_base) {
             m_out << ": ";
             first_base = false;
         } else {
             m_out << ", ";
         }
-        m_out << base_record->getName();
+        // The model has the qualified name, but the base is imported under its own name.
+        auto separator = base.rfind("::");
+        m_out << (separator == llvm::StringRef::npos ? base : base.drop_front(separator + 2));
     }
 }
 
-void JaktGenerator::printClassMethods(clang::CXXRecordDecl const* class_definition)
+void JaktGenerator::printClassMethods(ApiClass const& klass)
 {
-    auto for_each_method = [&](auto&& f) {
-        if (m_class_information.contains_methods_for(class_definition)) {
-            for (auto const& method : m_class_information.methods_for(class_definition))
-                f(method);
-        }
-    };
-
-    for_each_method([&](clang::CXXMethodDecl const* method) {
-        if (method->getAccess() == clang::AccessSpecifier::AS_private)
-            return;
-
+    for (ApiMethod const& method : klass.methods) {
         printIndentation();
 
-        if (method->getReturnType()->isReferenceType()) {
-            m_out << "// TODO: Method " << method->getName() << " returns a reference\n";
-            return;
+        if (method.kind == ApiMethod::Kind::ReturnsReference) {
+            ++NumMethodsSkippedReference;
+            m_out << "// TODO: Method " << method.name << " returns a reference\n";
+            continue;
         }
 
-        if (clang::FunctionTemplateDecl const* TD = method->getDescribedFunctionTemplate()) {
-            printClassTemplateMethod(method, TD);
-            return;
+        if (method.kind == ApiMethod::Kind::Template) {
+            ++NumMethodsSkippedTemplate;
+            printClassTemplateMethod(method);
+            continue;
         }
 
-        bool const is_constructor = llvm::isa<clang::CXXConstructorDecl>(method);
-        bool const is_static = method->isStatic() || is_constructor;
-        bool const is_virtual = method->isVirtual();
-        bool const is_protected = method->getAccess() == clang::AccessSpecifier::AS_protected;
-        assert(!(is_static && is_virtual));
-
-        if (!is_static || is_constructor) {
-            if (is_protected)
+        ++NumMethodsEmitted;
+        if (!method.is_static || method.is_constructor) {
+            if (method.is_protected)
                 m_out << "protected ";
             else
                 m_out << "public ";
 
-            if (is_virtual)
+            if (method.is_virtual)
                 m_out << "virtual ";
         }
 
-        m_out << "fn " << method->getDeclName() << "(";
+        m_out << "fn " << method.name << "(";
 
-        if (!is_static) {
-            if (!method->isConst()) {
+        if (!method.is_static) {
+            if (!method.is_const) {
                 m_out << "mut ";
             }
             m_out << "this";
-            if (method->getNumParams() > 0)
+            if (!method.parameters.empty())
                 m_out << ", ";
         }
 
-        for (auto i = 0U; i < method->getNumParams(); ++i) {
-            clang::ParmVarDecl const* param = method->parameters()[i];
-            printParameter(param, i, i + 1 == method->getNumParams());
-        }
+        for (auto i = 0U; i < method.parameters.size(); ++i)
+            printParameter(method.parameters[i], i, i + 1 == method.parameters.size());
 
         m_out << ") ";
         QualTypePrintFlags flags { QualTypePrintFlags::PF_IsReturnType };
-        if (isErrorOr(method->getReturnType())) {
+        if (isErrorOr(method.return_type)) {
             m_out << "throws ";
             flags |= QualTypePrintFlags::PF_InFunctionThatMayThrow;
         }
         m_out << "-> ";
-        if (is_constructor)
-            m_out << class_definition->getDeclName();
+        if (method.is_constructor)
+            m_out << klass.name;
         else
-            printQualType(method->getReturnType(), flags);
+            printQualType(method.return_type, flags);
         m_out << "\n";
-    });
+    }
 
     // FIXME: When variadic generics are added to jakt, don't hardcode these special cases.
     // Derived from Core::Object? Add [[name="try_create"]] <name> create() throws overload for each constructor
-    if (hasBaseNamed(class_definition, "Core::Object")) {
-        assert(hasBaseNamed(class_definition, "AK::RefCountedBase"));
-        for (clang::CXXConstructorDecl const* ctor : class_definition->ctors()) {
-            m_out << "    [[name=\"try_create\"]] fn create(";
-            if (!ctor->isDefaultConstructor() && !ctor->isCopyOrMoveConstructor() && !ctor->isDeleted()) {
-                for (auto i = 0U; i < ctor->getNumParams(); ++i) {
-                    clang::ParmVarDecl const* param = ctor->parameters()[i];
-                    printParameter(param, i, i + 1 == ctor->getNumParams());
-                }
-            }
-            m_out << ") throws -> " << class_definition->getName() << "\n";
-        }
+    for (auto const& factory : klass.factories) {
+        ++NumFactoriesEmitted;
+        m_out << "    [[name=\"try_create\"]] fn create(";
+        for (auto i = 0U; i < factory.size(); ++i)
+            printParameter(factory[i], i, i + 1 == factory.size());
+        m_out << ") throws -> " << klass.name << "\n";
     }
 }
 
-void JaktGenerator::printClassTemplateMethod(clang::CXXMethodDecl const* method_declaration, clang::FunctionTemplateDecl const*)
+void JaktGenerator::printClassTemplateMethod(ApiMethod const& method)
 {
-    m_out << "// TODO: Template method " << method_declaration->getQualifiedNameAsString() << "\n";
+    m_out << "// TODO: Template method " << method.name << "\n";
     // FIXME: Actually print this bad boy out
 }
 
-void JaktGenerator::printEnumeration(clang::EnumDecl const* enum_definition)
+void JaktGenerator::printEnumeration(ApiEnum const& enumeration)
 {
+    ++NumEnumsEmitted;
+
     printIndentation();
-    m_out << "enum " << enum_definition->getName();
-    if (enum_definition->isFixed()) {
-        m_out << " : " << rewriteQualTypeToJaktType(enum_definition->getIntegerType(), QualTypePrintFlags::PF_Nothing);
+    m_out << "enum " << enumeration.name;
+    if (enumeration.underlying_type.has_value()) {
+        m_out << " : ";
+        printQualType(enumeration.underlying_type.value(), QualTypePrintFlags::PF_Nothing);
     }
     m_out << " {\n";
     {
         IndentationIncreaser indent(m_indentation_level);
-        for (auto* constant_decl : enum_definition->enumerators()) {
+        for (auto const& enumerator : enumeration.enumerators) {
             printIndentation();
-            m_out << constant_decl->getName();
-            m_out << " = " << llvm::toString(constant_decl->getInitVal(), 10) << "\n";
+            m_out << enumerator.name;
+            m_out << " = " << enumerator.value << "\n";
         }
     }
     printIndentation();
     m_out << "}\n";
 }
 
-void JaktGenerator::printParameter(clang::ParmVarDecl const* parameter, unsigned int parameter_index, bool is_last_parameter)
+void JaktGenerator::printParameter(ApiParameter const& parameter, unsigned int parameter_index, bool is_last_parameter)
 {
-    m_out << rewriteParameter(parameter->getName(), parameter_index, parameter->getType());
+    m_scratch.clear();
+    appendParameter(m_scratch, parameter.name, parameter_index, parameter.type);
+    m_out << m_scratch;
     if (!is_last_parameter)
         m_out << ", ";
 }
 
-std::string JaktGenerator::rewriteParameter(llvm::StringRef name, unsigned int index, clang::QualType const& type)
+static void append(llvm::SmallVectorImpl<char>& out, llvm::StringRef text)
 {
-    std::string result;
+    out.append(text.begin(), text.end());
+}
 
+void JaktGenerator::appendParameter(llvm::SmallVectorImpl<char>& out, llvm::StringRef name, unsigned int index, ApiTypeIndex type)
+{
     if (!name.empty()) {
-        result += name;
+        append(out, name);
     } else {
-        result += "anon _param_";
-        result += std::to_string(index);
+        append(out, "anon _param_");
+        llvm::raw_svector_ostream(out) << index;
     }
-    result += ": ";
+    append(out, ": ");
 
-    result += rewriteQualTypeToJaktType(type, QualTypePrintFlags::PF_Nothing);
-    return result;
+    appendJaktType(out, type, QualTypePrintFlags::PF_Nothing);
 }
 
-std::string JaktGenerator::rewriteQualTypeToJaktType(clang::QualType const& base_type, QualTypePrintFlags flags)
+void JaktGenerator::appendJaktType(llvm::SmallVectorImpl<char>& out, ApiTypeIndex type, QualTypePrintFlags flags)
 {
-    auto type = base_type.getDesugaredType(*m_context);
-
-    if (has_flag(flags, QualTypePrintFlags::PF_InFunctionThatMayThrow) && has_flag(flags, QualTypePrintFlags::PF_IsReturnType)) {
-        auto result_type = getTemplateParameterIfMatches(type, "AK::ErrorOr");
-        if (result_type.has_value())
-            return rewriteQualTypeToJaktType(result_type.value(), flags);
+    auto key = std::make_pair(type, static_cast<unsigned>(flags));
+    if (auto it = m_rewritten_types.find(key); it != m_rewritten_types.end()) {
+        ++NumTypeSpellingsReused;
+        append(out, it->second);
+        return;
     }
 
-    if (auto inner_type = getTemplateParameterIfMatches(type, "AK::NonnullRefPtr"); inner_type.has_value())
-        return rewriteQualTypeToJaktType(inner_type.value(), flags & ~QualTypePrintFlags::PF_InFunctionThatMayThrow);
-
-    if (auto inner_type = getTemplateParameterIfMatches(type, "AK::Optional"); inner_type.has_value())
-        return rewriteQualTypeToJaktType(inner_type.value(), flags & ~QualTypePrintFlags::PF_InFunctionThatMayThrow) + "?";
+    // Spell the type in place, then keep a copy of what was appended for the next time it's needed.
+    auto start = out.size();
+    appendUncachedJaktType(out, type, flags);
+    m_rewritten_types.try_emplace(key, m_spellings.save(llvm::StringRef(out.data() + start, out.size() - start)));
+}
 
-    if (auto inner_type = getTemplateParameterIfMatches(type, "AK::DynamicArray"); inner_type.has_value())
-        return std::string("[") + rewriteQualTypeToJaktType(inner_type.value(), flags & ~QualTypePrintFlags::PF_InFunctionThatMayThrow) + "]";
+[[noreturn]] static void reportUnconvertibleType(ApiType const& type)
+{
+    std::string error_string = "Don't know how to convert ";
+    error_string += type.spelling;
+    error_string += " to a jakt type";
+    llvm::report_fatal_error(error_string.c_str(), false);
+}
 
-    if (auto key_type = getTemplateParameterIfMatches(type, "Jakt::Dictionary"); key_type.has_value()) {
-        auto value_type = getTemplateParameterIfMatches(type, "Jakt::Dictionary", 1);
-        return std::string("[")
-            + rewriteQualTypeToJaktType(key_type.value(), flags & ~QualTypePrintFlags::PF_InFunctionThatMayThrow)
-            + std::string(":")
-            + rewriteQualTypeToJaktType(value_type.value(), flags & ~QualTypePrintFlags::PF_InFunctionThatMayThrow)
-            + "]";
-    }
+bool JaktGenerator::appendMappedTemplate(llvm::SmallVectorImpl<char>& out, ApiType const& type, TemplateMapping const& mapping, QualTypePrintFlags flags)
+{
+    auto const inner_flags = flags & ~QualTypePrintFlags::PF_InFunctionThatMayThrow;
 
-    if (auto inner_type = getTemplateParameterIfMatches(type, "AK::WeakPtr"); inner_type.has_value()) {
-        return std::string("weak ")
-            + rewriteQualTypeToJaktType(inner_type.value(), flags & ~QualTypePrintFlags::PF_InFunctionThatMayThrow)
-            + "?";
+    switch (mapping.rule) {
+    case TemplateMapping::Rule::ErrorOr: {
+        // Only a throwing function's return type unwraps its ErrorOr, anywhere else it's spelled as is.
+        if (!has_flag(flags, QualTypePrintFlags::PF_InFunctionThatMayThrow) || !has_flag(flags, QualTypePrintFlags::PF_IsReturnType))
+            return false;
+        auto result_type = getTemplateArgument(type, 0);
+        if (!result_type.has_value())
+            return false;
+        appendJaktType(out, result_type.value(), flags);
+        return true;
     }
-
-    if (auto inner_type = getTemplateParameterIfMatches(type, "AK::Function"); inner_type.has_value()) {
-        std::string jakt_type = "fn(";
-        auto const* function_type = inner_type.value()->getAs<clang::FunctionProtoType>();
-        if (!function_type)
+    case TemplateMapping::Rule::Function: {
+        auto inner_type = getTemplateArgument(type, 0);
+        if (!inner_type.has_value())
+            return false;
+        auto const& function_type = typeAt(inner_type.value());
+        if (function_type.kind != ApiType::Kind::Function || function_type.children.empty())
             llvm::report_fatal_error("Function type is not a function as it ought to be", false);
 
+        append(out, "fn(");
+        auto return_type = function_type.children.front();
         bool first = true;
         unsigned index = 0;
-        for (auto const& param_type : function_type->param_types()) {
+        for (auto param_type : llvm::makeArrayRef(function_type.children).drop_front()) {
             if (first)
                 first = false;
             else
-                jakt_type += ", ";
+                append(out, ", ");
 
-            jakt_type += rewriteParameter("", index, param_type);
+            appendParameter(out, "", index, param_type);
         }
 
-        jakt_type += ")";
+        out.push_back(')');
 
         QualTypePrintFlags print_flags = QualTypePrintFlags::PF_IsReturnType;
-        if (isErrorOr(function_type->getReturnType())) {
-            jakt_type += " throws";
+        if (isErrorOr(return_type)) {
+            append(out, " throws");
             print_flags |= QualTypePrintFlags::PF_InFunctionThatMayThrow;
         }
 
-        jakt_type += " -> ";
-        jakt_type += rewriteQualTypeToJaktType(function_type->getReturnType(), print_flags);
-        return jakt_type;
+        append(out, " -> ");
+        appendJaktType(out, return_type, print_flags);
+        return true;
+    }
+    case TemplateMapping::Rule::Pattern:
+        break;
+    }
+
+    // Check every argument the pattern refers to before appending anything, so the generic spelling can be used instead.
+    for (auto const& piece : mapping.pieces) {
+        if (piece.argument.has_value() && !getTemplateArgument(type, piece.argument.value()).has_value())
+            return false;
     }
+    for (auto const& piece : mapping.pieces) {
+        append(out, piece.text);
+        if (piece.argument.has_value())
+            appendJaktType(out, type.children[piece.argument.value()], inner_flags);
+    }
+    return true;
+}
 
-    auto is_mutable = !type.isConstQualified();
+void JaktGenerator::appendUncachedJaktType(llvm::SmallVectorImpl<char>& out, ApiTypeIndex type_index, QualTypePrintFlags flags)
+{
+    auto const& type = typeAt(type_index);
+    auto const inner_flags = flags & ~QualTypePrintFlags::PF_InFunctionThatMayThrow;
+    auto is_mutable = !type.is_const;
 
-    if (auto const* reference_type = type->getAs<clang::ReferenceType>()) {
+    switch (type.kind) {
+    case ApiType::Kind::Reference:
         assert(!has_flag(flags, QualTypePrintFlags::PF_IsReturnType));
-        std::string prefix = is_mutable ? "&mut " : "& ";
-        return prefix + rewriteQualTypeToJaktType(reference_type->getPointeeType(), flags & ~QualTypePrintFlags::PF_InFunctionThatMayThrow);
+        append(out, is_mutable ? "&mut " : "& ");
+        appendJaktType(out, type.children.front(), inner_flags);
+        return;
+
+    case ApiType::Kind::Pointer: {
+        auto pointee_type = type.children.front();
+        append(out, typeAt(pointee_type).is_const ? "raw " : "mut raw ");
+        appendJaktType(out, pointee_type, inner_flags);
+        return;
     }
 
-    if (auto const* pointer_type = type->getAs<clang::PointerType>()) {
-        std::string prefix = pointer_type->getPointeeType().isConstQualified() ? "raw " : "mut raw ";
-        return prefix + rewriteQualTypeToJaktType(pointer_type->getPointeeType(), flags & ~QualTypePrintFlags::PF_InFunctionThatMayThrow);
+    case ApiType::Kind::Builtin: {
+        auto jakt_type = m_type_map.builtin(type.name);
+        if (!jakt_type.has_value())
+            reportUnconvertibleType(type);
+        ++NumTypesRewritten;
+        append(out, jakt_type.value());
+        return;
     }
 
-    if (auto const* builtin_type = type->getAs<clang::BuiltinType>()) {
-        switch (builtin_type->getKind()) {
-        case clang::BuiltinType::Void:
-            return "void";
-        case clang::BuiltinType::Bool:
-            return "bool";
-        case clang::BuiltinType::Char_U:
-        case clang::BuiltinType::Char_S:
-            return "c_char";
-        case clang::BuiltinType::SChar:
-            return "i8";
-        case clang::BuiltinType::UChar:
-            return "u8";
-        case clang::BuiltinType::WChar_U:
-        case clang::BuiltinType::WChar_S:
-            return "c_char"; // lol
-        case clang::BuiltinType::Char8:
-            return "i8";
-        case clang::BuiltinType::Char16:
-            return "i16";
-        case clang::BuiltinType::Char32:
-            return "i32";
-        case clang::BuiltinType::UShort:
-            return "u16";
-        case clang::BuiltinType::Short:
-            return "i16";
-        case clang::BuiltinType::UInt:
-        case clang::BuiltinType::ULong:
-        case clang::BuiltinType::ULongLong:
-        case clang::BuiltinType::UInt128:
-        case clang::BuiltinType::Int:
-        case clang::BuiltinType::Long:
-        case clang::BuiltinType::LongLong:
-        case clang::BuiltinType::Int128:
-            return "c_int";
-        case clang::BuiltinType::Float:
-            return "f32";
-        case clang::BuiltinType::Double:
-        case clang::BuiltinType::LongDouble:
-            return "f64";
-        case clang::BuiltinType::NullPtr:
-            return "raw void"; // hehehe
-        default: {
-            std::string error_string = "Don't know how to convert ";
-            error_string += base_type.getAsString();
-            error_string += " to a jakt type";
-            llvm::report_fatal_error(error_string.c_str(), false);
-        }
+    case ApiType::Kind::Template: {
+        if (auto const* mapping = m_type_map.templateMapping(type.name); mapping && appendMappedTemplate(out, type, *mapping, flags)) {
+            ++NumTypesRewritten;
+            return;
         }
-    }
 
-    if (auto* record_type = type->getAs<clang::RecordType>()) {
-        if (auto* specialization = llvm::dyn_cast<clang::ClassTemplateSpecializationDecl>(record_type->getAsRecordDecl())) {
-            // decl < param... >
-            std::string result = specialization->getQualifiedNameAsString();
-            result += "<";
-            auto& args = specialization->getTemplateArgs();
-            for (size_t i = 0; i < args.size(); ++i) {
-                if (args[i].getKind() != clang::TemplateArgument::Type) {
-                    llvm::errs() << "Saw an NTTP (of kind " << args[i].getKind() << "), can't do that yet :(\n";
-                    break;
-                }
-
-                if (i != 0)
-                    result += ", ";
-                result += rewriteQualTypeToJaktType(args[i].getAsType(), QualTypePrintFlags::PF_Nothing);
+        // decl < param... >
+        ++NumTypesUnmapped;
+        append(out, type.name);
+        out.push_back('<');
+        for (size_t i = 0; i < type.children.size(); ++i) {
+            if (type.children[i] == ApiType::non_type_argument) {
+                ++NumNonTypeArguments;
+                noteUnsupportedTemplate(type.spelling);
+                break;
             }
 
-            result += ">";
-            return result;
+            if (i != 0)
+                append(out, ", ");
+            appendJaktType(out, type.children[i], QualTypePrintFlags::PF_Nothing);
         }
 
-        auto name = type->getAsCXXRecordDecl()->getQualifiedNameAsString();
-        if (name == "AK::StringView")
-            return "StringView";
-        if (name == "AK::DeprecatedString")
-            return "String";
-
-        return type.withoutLocalFastQualifiers().getAsString(m_printing_policy);
+        out.push_back('>');
+        return;
     }
 
-    if (auto* enum_type = type->getAs<clang::EnumType>()) {
-        return type.withoutLocalFastQualifiers().getAsString(m_printing_policy);
+    case ApiType::Kind::Record:
+        if (auto jakt_type = m_type_map.record(type.name); jakt_type.has_value()) {
+            ++NumTypesRewritten;
+            return append(out, jakt_type.value());
+        }
+        ++NumTypesUnmapped;
+        return append(out, type.spelling);
+
+    case ApiType::Kind::Enum:
+        return append(out, type.spelling);
+
+    case ApiType::Kind::Function:
+    case ApiType::Kind::Unsupported:
+        break;
     }
 
-    std::string error_string = "Don't know how to convert ";
-    error_string += base_type.getAsString();
-    error_string += " to a jakt type";
-    llvm::report_fatal_error(error_string.c_str(), false);
+    reportUnconvertibleType(type);
 }
 
 }
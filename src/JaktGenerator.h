@@ -6,25 +6,41 @@
 
 #pragma once
 
+#include "ApiModel.h"
 #include "EnumBits.h"
-#include <clang/AST/Decl.h>
-#include <clang/AST/DeclCXX.h>
-#include <clang/AST/DeclTemplate.h>
-#include <clang/AST/Type.h>
-#include <clang/Frontend/CompilerInstance.h>
-#include <clang/Tooling/Tooling.h>
+#include "TypeMap.h"
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/StringSaver.h>
 #include <llvm/Support/raw_ostream.h>
 #include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
-namespace jakt_bindgen {
+namespace llvm {
+class ThreadPool;
+}
 
-class CXXClassListener;
+namespace jakt_bindgen {
 
-class JaktGenerator : public clang::tooling::SourceFileCallbacks {
+class JaktGenerator {
 public:
-    JaktGenerator(llvm::raw_ostream& out, CXXClassListener const& class_information);
+    JaktGenerator(llvm::raw_ostream& out, ApiHeader const& header, TypeMap const& type_map);
+
+    // With a pool, the top level tags are rendered concurrently into separate buffers, each by its own generator,
+    // then written out in declaration order. The model is immutable, so the output is the same either way.
+    void generate(llvm::ThreadPool* pool = nullptr);
 
-    void generate(std::string const& header_path);
+    // Imports these instead of the ones in the model, e.g. the ones a SymbolIndex resolved for it.
+    void setImports(std::vector<ApiImport> const& imports) { m_imports = &imports; }
+
+    // Templates whose non-type arguments couldn't be spelled, each once and in the order generate() first saw them.
+    // The generator never prints them itself, since it may run on pool threads; the caller reports them.
+    std::vector<std::string> const& unsupportedTemplates() const { return m_unsupported_templates; }
 
     enum class QualTypePrintFlags {
         PF_Nothing = 0,
@@ -38,35 +54,33 @@ private:
     void printImportExternBegin(std::string const& header);
     void printImportExternEnd();
 
-    void printNamespaceBegin(clang::NamespaceDecl const* ns);
+    void printNamespaceBegin(std::string const& ns);
     void printNamespaceEnd();
 
-    void printTagDecl(clang::TagDecl const* tag_declaration);
+    void printTag(ApiTag const& tag);
+    void noteUnsupportedTemplate(llvm::StringRef spelling);
+    void printTagsConcurrently(llvm::ThreadPool& pool);
 
-    void printClass(clang::CXXRecordDecl const* class_definition);
-    void printClassDeclaration(clang::CXXRecordDecl const* class_definition);
-    void printClassMethods(clang::CXXRecordDecl const* class_definition);
-    void printClassTemplateMethod(clang::CXXMethodDecl const* method_declaration, clang::FunctionTemplateDecl const* template_method);
+    void printClass(ApiClass const& klass);
+    void printClassDeclaration(ApiClass const& klass);
+    void printClassMethods(ApiClass const& klass);
+    void printClassTemplateMethod(ApiMethod const& method);
 
-    void printEnumeration(clang::EnumDecl const* enum_definition);
+    void printEnumeration(ApiEnum const& enumeration);
 
-    void printParameter(clang::ParmVarDecl const* parameter, unsigned int parameter_index, bool is_last_parameter);
-    std::string rewriteParameter(llvm::StringRef name, unsigned index, clang::QualType const& type);
+    void printParameter(ApiParameter const& parameter, unsigned int parameter_index, bool is_last_parameter);
+    void appendParameter(llvm::SmallVectorImpl<char>& out, llvm::StringRef name, unsigned index, ApiTypeIndex type);
 
-    std::string rewriteQualTypeToJaktType(clang::QualType const& type, QualTypePrintFlags flags);
+    // Spelling a type appends to a buffer owned by the caller instead of returning strings, so that nested types
+    // never allocate temporaries. Each distinct (type, flags) pair is spelled once, then copied from the arena.
+    void appendJaktType(llvm::SmallVectorImpl<char>& out, ApiTypeIndex type, QualTypePrintFlags flags);
+    void appendUncachedJaktType(llvm::SmallVectorImpl<char>& out, ApiTypeIndex type, QualTypePrintFlags flags);
 
-    void printQualType(clang::QualType const& type, QualTypePrintFlags flags)
+    void printQualType(ApiTypeIndex type, QualTypePrintFlags flags)
     {
-        m_out << rewriteQualTypeToJaktType(type, flags);
-    }
-
-    virtual bool handleBeginSource(clang::CompilerInstance& CI) override
-    {
-        if (!CI.hasASTContext())
-            CI.createASTContext();
-
-        m_context = &CI.getASTContext();
-        return true;
+        m_scratch.clear();
+        appendJaktType(m_scratch, type, flags);
+        m_out << m_scratch;
     }
 
     void printIndentation()
@@ -84,14 +98,32 @@ private:
         uint32_t& m_i;
     };
 
-    bool isErrorOr(clang::QualType const&) const;
-    std::optional<clang::QualType> getTemplateParameterIfMatches(clang::QualType const&, llvm::StringRef template_name, unsigned index = 0) const;
+    ApiType const& typeAt(ApiTypeIndex index) const { return m_header.types[index]; }
+
+    TemplateMapping const* templateMappingOf(ApiType const& type) const
+    {
+        return type.kind == ApiType::Kind::Template ? m_type_map.templateMapping(type.name) : nullptr;
+    }
+    bool isErrorOr(ApiTypeIndex) const;
+    std::optional<ApiTypeIndex> getTemplateArgument(ApiType const&, unsigned index) const;
+    bool appendMappedTemplate(llvm::SmallVectorImpl<char>& out, ApiType const& type, TemplateMapping const& mapping, QualTypePrintFlags flags);
 
     llvm::raw_ostream& m_out;
-    CXXClassListener const& m_class_information;
-    clang::PrintingPolicy m_printing_policy;
+    ApiHeader const& m_header;
+    TypeMap const& m_type_map;
+    std::vector<ApiImport> const* m_imports { nullptr };
     uint32_t m_indentation_level { 0 };
-    clang::ASTContext const* m_context { nullptr };
+
+    // Reused for every type and parameter printed to m_out.
+    llvm::SmallString<128> m_scratch;
+
+    // Jakt spellings of the types seen so far, along with the QualTypePrintFlags they were rewritten with.
+    // The spellings live in the arena for as long as the generator does.
+    llvm::BumpPtrAllocator m_spelling_arena;
+    llvm::StringSaver m_spellings { m_spelling_arena };
+    llvm::DenseMap<std::pair<ApiTypeIndex, unsigned>, llvm::StringRef> m_rewritten_types;
+
+    std::vector<std::string> m_unsupported_templates;
 };
 
 ENUM_BITWISE_OPERATORS(JaktGenerator::QualTypePrintFlags)
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "KnownDecls.h"
+#include <clang/AST/CXXInheritance.h>
+#include <clang/AST/DeclBase.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Casting.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <utility>
+
+namespace jakt_bindgen {
+
+// Looks up a namespace-qualified name such as "AK::ErrorOr" from the translation unit,
+// without adding identifiers that were never seen to the identifier table.
+static clang::NamedDecl const* lookupQualifiedName(clang::ASTContext const& context, llvm::StringRef qualified_name)
+{
+    clang::DeclContext const* scope = context.getTranslationUnitDecl();
+    clang::NamedDecl const* result = nullptr;
+
+    while (!qualified_name.empty()) {
+        auto [component, rest] = qualified_name.split("::");
+        qualified_name = rest;
+
+        if (!scope)
+            return nullptr;
+        auto identifier = context.Idents.find(component);
+        if (identifier == context.Idents.end())
+            return nullptr;
+
+        auto lookup = scope->lookup(clang::DeclarationName(identifier->getValue()));
+        if (lookup.empty())
+            return nullptr;
+
+        result = lookup.front();
+        scope = llvm::dyn_cast<clang::DeclContext>(result);
+    }
+    return result;
+}
+
+static constexpr KnownDecls::Template s_templates[] = {
+    KnownDecls::Template::ErrorOr,
+    KnownDecls::Template::NonnullRefPtr,
+    KnownDecls::Template::Optional,
+    KnownDecls::Template::DynamicArray,
+    KnownDecls::Template::Dictionary,
+    KnownDecls::Template::WeakPtr,
+    KnownDecls::Template::Function,
+    KnownDecls::Template::RefCounted,
+    KnownDecls::Template::Weakable,
+};
+
+static constexpr KnownDecls::Record s_records[] = {
+    KnownDecls::Record::StringView,
+    KnownDecls::Record::DeprecatedString,
+    KnownDecls::Record::RefCountedBase,
+    KnownDecls::Record::CoreObject,
+};
+
+llvm::StringRef KnownDecls::qualifiedName(Template known_template)
+{
+    switch (known_template) {
+    case Template::ErrorOr:
+        return "AK::ErrorOr";
+    case Template::NonnullRefPtr:
+        return "AK::NonnullRefPtr";
+    case Template::Optional:
+        return "AK::Optional";
+    case Template::DynamicArray:
+        return "AK::DynamicArray";
+    case Template::Dictionary:
+        return "Jakt::Dictionary";
+    case Template::WeakPtr:
+        return "AK::WeakPtr";
+    case Template::Function:
+        return "AK::Function";
+    case Template::RefCounted:
+        return "AK::RefCounted";
+    case Template::Weakable:
+        return "AK::Weakable";
+    }
+    llvm_unreachable("Unknown template");
+}
+
+llvm::StringRef KnownDecls::qualifiedName(Record known_record)
+{
+    switch (known_record) {
+    case Record::StringView:
+        return "AK::StringView";
+    case Record::DeprecatedString:
+        return "AK::DeprecatedString";
+    case Record::RefCountedBase:
+        return "AK::RefCountedBase";
+    case Record::CoreObject:
+        return "Core::Object";
+    }
+    llvm_unreachable("Unknown record");
+}
+
+KnownDecls::KnownDecls(clang::ASTContext const& context)
+{
+    for (auto known_template : s_templates) {
+        if (auto const* decl = llvm::dyn_cast_or_null<clang::ClassTemplateDecl>(lookupQualifiedName(context, qualifiedName(known_template))))
+            m_templates.try_emplace(decl->getCanonicalDecl(), known_template);
+    }
+    for (auto known_record : s_records) {
+        if (auto const* decl = llvm::dyn_cast_or_null<clang::CXXRecordDecl>(lookupQualifiedName(context, qualifiedName(known_record))))
+            m_records.try_emplace(decl->getCanonicalDecl(), known_record);
+    }
+}
+
+std::optional<KnownDecls::Template> KnownDecls::templateOf(clang::CXXRecordDecl const* record) const
+{
+    auto const* specialization = llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(record);
+    if (!specialization)
+        return {};
+
+    auto it = m_templates.find(specialization->getSpecializedTemplate()->getCanonicalDecl());
+    if (it == m_templates.end())
+        return {};
+    return it->second;
+}
+
+std::optional<KnownDecls::Template> KnownDecls::templateOf(clang::QualType const& type) const
+{
+    if (auto const* record_type = llvm::dyn_cast<clang::RecordType>(type.getCanonicalType()))
+        return templateOf(llvm::dyn_cast<clang::CXXRecordDecl>(record_type->getDecl()));
+    return {};
+}
+
+bool KnownDecls::is(clang::CXXRecordDecl const* record, Record known_record) const
+{
+    auto it = m_records.find(record->getCanonicalDecl());
+    return it != m_records.end() && it->second == known_record;
+}
+
+bool KnownDecls::derivesFrom(clang::CXXRecordDecl const* class_definition, Record known_record) const
+{
+    clang::CXXBasePaths paths;
+    paths.setOrigin(class_definition);
+
+    return class_definition->lookupInBases([&](clang::CXXBaseSpecifier const* base, clang::CXXBasePath&) -> bool {
+        auto const* record_type = base->getType()->getAs<clang::RecordType>();
+        if (!record_type)
+            return false;
+        return is(llvm::cast<clang::CXXRecordDecl>(record_type->getDecl()), known_record);
+    },
+        paths, true);
+}
+
+std::optional<clang::QualType> KnownDecls::templateArgument(clang::QualType const& type, Template known_template, unsigned index) const
+{
+    if (templateOf(type) != known_template)
+        return {};
+
+    auto const* record_type = llvm::cast<clang::RecordType>(type.getCanonicalType());
+    auto const& arguments = llvm::cast<clang::ClassTemplateSpecializationDecl>(record_type->getDecl())->getTemplateArgs();
+    if (arguments.size() <= index)
+        return {};
+    return arguments[index].getAsType();
+}
+
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/DeclTemplate.h>
+#include <clang/AST/Type.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <optional>
+
+namespace jakt_bindgen {
+
+// The AK, LibCore and Jakt declarations that get special treatment in bindings.
+// They're looked up once per translation unit, so types can be checked against them by declaration identity
+// instead of building and comparing qualified name strings for every type we see.
+class KnownDecls {
+public:
+    enum class Template {
+        ErrorOr,
+        NonnullRefPtr,
+        Optional,
+        DynamicArray,
+        Dictionary,
+        WeakPtr,
+        Function,
+        RefCounted,
+        Weakable,
+    };
+
+    enum class Record {
+        StringView,
+        DeprecatedString,
+        RefCountedBase,
+        CoreObject,
+    };
+
+    explicit KnownDecls(clang::ASTContext const& context);
+
+    // The fully qualified name the known declaration is looked up by, e.g. "AK::ErrorOr".
+    static llvm::StringRef qualifiedName(Template known_template);
+    static llvm::StringRef qualifiedName(Record known_record);
+
+    // Which known template, if any, the record is a specialization of.
+    std::optional<Template> templateOf(clang::CXXRecordDecl const* record) const;
+    std::optional<Template> templateOf(clang::QualType const& type) const;
+
+    bool is(clang::CXXRecordDecl const* record, Record known_record) const;
+
+    // Whether the class derives from the known record, directly or indirectly.
+    bool derivesFrom(clang::CXXRecordDecl const* class_definition, Record known_record) const;
+
+    // The type argument at index if the type is a specialization of the known template.
+    std::optional<clang::QualType> templateArgument(clang::QualType const& type, Template known_template, unsigned index = 0) const;
+
+private:
+    llvm::DenseMap<clang::ClassTemplateDecl const*, Template> m_templates;
+    llvm::DenseMap<clang::CXXRecordDecl const*, Record> m_records;
+};
+
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "MemoryUsage.h"
+#include <fstream>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace jakt_bindgen {
+
+size_t peakResidentSetSize()
+{
+    struct rusage usage { };
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss;
+#else
+    return usage.ru_maxrss * 1024;
+#endif
+}
+
+std::optional<size_t> currentResidentSetSize()
+{
+#ifdef __linux__
+    // The second field of statm is the number of resident pages.
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages))
+        return {};
+    return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return {};
+#endif
+}
+
+}
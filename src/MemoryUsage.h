@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+
+namespace jakt_bindgen {
+
+// High-water mark of the resident set of the whole process, in bytes. Only ever grows.
+size_t peakResidentSetSize();
+
+// Resident set of the whole process right now, in bytes. Empty where the platform doesn't tell us.
+std::optional<size_t> currentResidentSetSize();
+
+}
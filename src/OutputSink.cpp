@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "OutputSink.h"
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <llvm/Support/raw_ostream.h>
+#include <utility>
+
+#define DEBUG_TYPE "output"
+
+namespace jakt_bindgen {
+
+ALWAYS_ENABLED_STATISTIC(NumFilesWritten, "Files written to disk");
+ALWAYS_ENABLED_STATISTIC(NumFilesUnchanged, "Files left alone as their contents were unchanged");
+ALWAYS_ENABLED_STATISTIC(NumBytesWritten, "Bytes written to disk");
+
+namespace {
+
+class FileOutputSink final : public OutputSink {
+public:
+    // The new contents go to a temporary file next to the output that's renamed over it once complete.
+    llvm::Error write(std::string const& path, llvm::StringRef contents) override
+    {
+        llvm::TimeTraceScope scope("WriteOutput", path);
+
+        auto existing = llvm::MemoryBuffer::getFile(path, /* IsText = */ false, /* RequiresNullTerminator = */ false);
+        if (existing && (*existing)->getBuffer() == contents) {
+            ++NumFilesUnchanged;
+            return llvm::Error::success();
+        }
+
+        ++NumFilesWritten;
+        NumBytesWritten += contents.size();
+
+        return llvm::writeToOutput(path, [&](llvm::raw_ostream& os) {
+            os << contents;
+            return llvm::Error::success();
+        });
+    }
+};
+
+}
+
+OutputSink& OutputSink::files()
+{
+    static FileOutputSink sink;
+    return sink;
+}
+
+llvm::Error MemoryOutputSink::write(std::string const& path, llvm::StringRef contents)
+{
+    std::scoped_lock lock(m_lock);
+    m_files[path] = contents.str();
+    return llvm::Error::success();
+}
+
+llvm::StringMap<std::string> MemoryOutputSink::takeFiles()
+{
+    std::scoped_lock lock(m_lock);
+    return std::exchange(m_files, {});
+}
+
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Error.h>
+#include <mutex>
+#include <string>
+
+namespace jakt_bindgen {
+
+// Where generated files (bindings, and API models with emit_api_model) go.
+// Written to concurrently by every worker of a BindingRunner.
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+
+    virtual llvm::Error write(std::string const& path, llvm::StringRef contents) = 0;
+
+    // Writes to disk. Downstream Jakt builds key off the mtime of the generated files, so files whose contents
+    // are unchanged are left alone.
+    static OutputSink& files();
+};
+
+// Keeps every file in memory, keyed by the path it would have been written to.
+class MemoryOutputSink final : public OutputSink {
+public:
+    llvm::Error write(std::string const& path, llvm::StringRef contents) override;
+
+    // The files written since the last call.
+    llvm::StringMap<std::string> takeFiles();
+
+private:
+    std::mutex m_lock;
+    llvm::StringMap<std::string> m_files;
+};
+
+}
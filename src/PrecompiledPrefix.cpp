@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "PrecompiledPrefix.h"
+#include "BindingCache.h"
+#include "CompileCommands.h"
+#include "IncludeCollector.h"
+#include <clang/Basic/Version.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Serialization/PCHContainerOperations.h>
+#include <clang/Tooling/Tooling.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <system_error>
+
+namespace jakt_bindgen {
+
+namespace {
+
+class PrecompilePrefixAction final : public clang::GeneratePCHAction {
+public:
+    explicit PrecompilePrefixAction(std::vector<std::string>& dependencies)
+        : m_dependencies(dependencies)
+    {
+    }
+
+protected:
+    virtual bool BeginSourceFileAction(clang::CompilerInstance& CI) override
+    {
+        m_collector = std::make_shared<IncludeCollector>();
+        m_collector->attachToPreprocessor(CI.getPreprocessor());
+        return clang::GeneratePCHAction::BeginSourceFileAction(CI);
+    }
+
+    virtual void EndSourceFileAction() override
+    {
+        m_dependencies = m_collector->absoluteDependencies(getCompilerInstance().getFileManager());
+        clang::GeneratePCHAction::EndSourceFileAction();
+    }
+
+private:
+    std::vector<std::string>& m_dependencies;
+    std::shared_ptr<IncludeCollector> m_collector;
+};
+
+class PrecompilePrefixActionFactory final : public clang::tooling::FrontendActionFactory {
+public:
+    virtual std::unique_ptr<clang::FrontendAction> create() override
+    {
+        return std::make_unique<PrecompilePrefixAction>(m_dependencies);
+    }
+
+    std::vector<std::string> const& dependencies() const { return m_dependencies; }
+
+private:
+    std::vector<std::string> m_dependencies;
+};
+
+}
+
+// The flags ClangTool will hand our adjuster for a given compile command, minus the input file.
+static std::vector<std::string> toolFlagsFor(clang::tooling::CompileCommand const& command)
+{
+    // Keep in sync with the adjusters that clang::tooling::ClangTool installs in its constructor.
+    auto adjuster = clang::tooling::combineAdjusters(
+        clang::tooling::combineAdjusters(clang::tooling::getClangStripOutputAdjuster(), clang::tooling::getClangSyntaxOnlyAdjuster()),
+        clang::tooling::getClangStripDependencyFileAdjuster());
+    return removeInputFile(adjuster(command.CommandLine, command.Filename), command.Filename);
+}
+
+static bool writeFileIfChanged(std::filesystem::path const& path, std::string const& contents)
+{
+    if (auto existing = llvm::MemoryBuffer::getFile(path.string()); existing && existing.get()->getBuffer() == contents)
+        return true;
+
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path.string(), ec, llvm::sys::fs::CD_CreateAlways);
+    if (ec) {
+        llvm::errs() << "Can't write " << path.string() << ": " << ec.message() << "\n";
+        return false;
+    }
+    os << contents;
+    return true;
+}
+
+std::unique_ptr<PrecompiledPrefix> PrecompiledPrefix::create(clang::tooling::CompilationDatabase const& compilations, std::string const& reference_source,
+    std::vector<std::string> const& includes, BindingCache* cache)
+{
+    auto commands = compilations.getCompileCommands(reference_source);
+    if (commands.empty())
+        return nullptr;
+    auto const& command = commands.front();
+
+    auto prefix = std::unique_ptr<PrecompiledPrefix>(new PrecompiledPrefix);
+    prefix->m_flags = toolFlagsFor(command);
+
+    auto flags = flagsForOtherInput(command);
+    // A PCH can only be loaded by the exact clang that wrote it.
+    std::vector<std::string> key_inputs { "precompiled-prefix", clang::getClangFullVersion(), command.Directory };
+    key_inputs.insert(key_inputs.end(), flags.begin(), flags.end());
+    key_inputs.insert(key_inputs.end(), includes.begin(), includes.end());
+    auto key = BindingCache::computeKey(key_inputs);
+
+    std::filesystem::path directory;
+    if (cache) {
+        directory = cache->directory() / "pch";
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        if (ec) {
+            llvm::errs() << "Can't create PCH directory " << directory.string() << ": " << ec.message() << "\n";
+            return nullptr;
+        }
+    } else {
+        llvm::SmallString<256> temporary_directory;
+        if (auto ec = llvm::sys::fs::createUniqueDirectory((std::filesystem::temp_directory_path() / "jakt-bindgen-pch").string(), temporary_directory)) {
+            llvm::errs() << "Can't create temporary PCH directory: " << ec.message() << "\n";
+            return nullptr;
+        }
+        directory = temporary_directory.str().str();
+        prefix->m_temporary_directory = directory;
+    }
+
+    auto header_path = directory / ("prefix-" + key + ".h");
+    prefix->m_pch_path = directory / ("prefix-" + key + ".pch");
+
+    if (cache && std::filesystem::exists(prefix->m_pch_path) && cache->isUpToDate(header_path.string(), key)) {
+        prefix->m_dependencies = cache->dependencies(header_path.string());
+        return prefix;
+    }
+
+    std::string header_contents = "// Generated by jakt-bindgen. Common include prefix for the headers being bound.\n";
+    for (auto const& include : includes)
+        header_contents += "#include <" + include + ">\n";
+    if (!writeFileIfChanged(header_path, header_contents))
+        return nullptr;
+
+    if (!prefix->build(command, flags, header_path))
+        return nullptr;
+
+    if (cache)
+        cache->update(header_path.string(), key, prefix->m_pch_path.string(), prefix->m_dependencies);
+
+    return prefix;
+}
+
+PrecompiledPrefix::~PrecompiledPrefix()
+{
+    if (!m_temporary_directory.empty()) {
+        std::error_code ec;
+        std::filesystem::remove_all(m_temporary_directory, ec);
+    }
+}
+
+bool PrecompiledPrefix::build(clang::tooling::CompileCommand const& command, std::vector<std::string> const& flags, std::filesystem::path const& header_path)
+{
+    // FixedCompilationDatabase supplies its own compiler executable and appends the input file.
+    std::vector<std::string> arguments(flags.begin() + 1, flags.end());
+    // Leave input file timestamps out of the PCH: BindingCache already decides staleness by content,
+    // and a touched-but-unchanged AK header shouldn't make every translation unit reject the PCH.
+    arguments.insert(arguments.end(), { "-Xclang", "-fno-pch-timestamp", "-x", "c++-header", "-o", m_pch_path.string() });
+    clang::tooling::FixedCompilationDatabase compilations(command.Directory, arguments);
+
+    clang::tooling::ClangTool tool(compilations, { header_path.string() },
+        std::make_shared<clang::PCHContainerOperations>(), llvm::vfs::createPhysicalFileSystem());
+    // The default adjusters would turn this into a -fsyntax-only run without an output file.
+    tool.clearArgumentsAdjusters();
+
+    PrecompilePrefixActionFactory factory;
+    if (tool.run(&factory) != 0) {
+        llvm::errs() << "Failed to precompile the common include prefix\n";
+        return false;
+    }
+
+    m_dependencies = factory.dependencies();
+    return true;
+}
+
+clang::tooling::ArgumentsAdjuster PrecompiledPrefix::argumentsAdjuster() const
+{
+    return [flags = m_flags, pch_path = m_pch_path.string()](clang::tooling::CommandLineArguments const& arguments, llvm::StringRef filename) {
+        // A PCH can only be used by a TU with matching language options and macro definitions.
+        if (removeInputFile(arguments, filename) != flags)
+            return arguments;
+        return clang::tooling::getInsertArgumentAdjuster({ "-include-pch", pch_path }, clang::tooling::ArgumentInsertPosition::BEGIN)(arguments, filename);
+    };
+}
+
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <clang/Tooling/ArgumentsAdjusters.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+class BindingCache;
+
+// A PCH of the include prefix (AK, LibCore, ...) shared by most of the headers in a run.
+// It's built once with the flags of a reference header, and every translation unit whose compile command
+// has the same flags loads it with -include-pch instead of parsing the prefix again.
+class PrecompiledPrefix {
+public:
+    // If a cache is given, the PCH is kept in its directory and reused by later runs while its inputs are unchanged.
+    // Otherwise it's built in a temporary directory that is removed along with this object.
+    static std::unique_ptr<PrecompiledPrefix> create(clang::tooling::CompilationDatabase const& compilations, std::string const& reference_source,
+        std::vector<std::string> const& includes, BindingCache* cache);
+    ~PrecompiledPrefix();
+
+    clang::tooling::ArgumentsAdjuster argumentsAdjuster() const;
+
+    // Files that went into the PCH. These are dependencies of every header that uses it, but aren't seen by
+    // the preprocessor of those headers.
+    std::vector<std::string> const& dependencies() const { return m_dependencies; }
+
+    std::filesystem::path const& pchPath() const { return m_pch_path; }
+
+private:
+    PrecompiledPrefix() = default;
+
+    bool build(clang::tooling::CompileCommand const& command, std::vector<std::string> const& flags, std::filesystem::path const& header_path);
+
+    std::filesystem::path m_pch_path;
+    std::filesystem::path m_temporary_directory;
+    std::vector<std::string> m_flags;
+    std::vector<std::string> m_dependencies;
+};
+
+}
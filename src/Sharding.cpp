@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "Sharding.h"
+#include "SourceFileHandler.h"
+#include <algorithm>
+#include <limits>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+namespace jakt_bindgen {
+
+std::optional<ShardSpec> ShardSpec::parse(llvm::StringRef spec)
+{
+    auto [index_string, count_string] = spec.split('/');
+    ShardSpec shard;
+    if (index_string.getAsInteger(10, shard.index) || count_string.getAsInteger(10, shard.count))
+        return {};
+    if (shard.count == 0 || shard.index >= shard.count)
+        return {};
+    return shard;
+}
+
+std::vector<std::string> selectShard(std::vector<std::string> const& sources, std::filesystem::path const& base_dir, ShardSpec shard)
+{
+    struct Candidate {
+        std::string path;
+        std::string relative_path;
+        uint64_t size { 0 };
+    };
+
+    std::vector<Candidate> candidates;
+    for (auto const& source : sources) {
+        auto path = std::filesystem::absolute(source).lexically_normal();
+        Candidate candidate { path.string(), path.lexically_relative(base_dir).generic_string(), 0 };
+        llvm::sys::fs::file_size(candidate.path, candidate.size);
+        candidates.push_back(std::move(candidate));
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](auto const& a, auto const& b) {
+        return a.relative_path < b.relative_path;
+    });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), [](auto const& a, auto const& b) {
+        return a.relative_path == b.relative_path;
+    }),
+        candidates.end());
+
+    // Largest first, each to the least loaded shard. A recorded cost (say, from the cache) would balance better,
+    // but CI runners don't share a cache, and every runner has to agree on the partition.
+    std::stable_sort(candidates.begin(), candidates.end(), [](auto const& a, auto const& b) { return a.size > b.size; });
+
+    std::vector<uint64_t> loads(shard.count, 0);
+    std::vector<std::string> selected;
+    for (auto& candidate : candidates) {
+        auto least_loaded = std::min_element(loads.begin(), loads.end());
+        // Count every header for at least one byte, so that empty files are spread out as well.
+        *least_loaded += std::max<uint64_t>(candidate.size, 1);
+        if (static_cast<unsigned>(least_loaded - loads.begin()) == shard.index)
+            selected.push_back(std::move(candidate.path));
+    }
+
+    std::sort(selected.begin(), selected.end());
+    return selected;
+}
+
+ShardManifest ShardManifest::create(ShardSpec shard, std::vector<std::string> const& sources, std::filesystem::path const& base_dir, std::filesystem::path const& out_dir)
+{
+    ShardManifest manifest;
+    manifest.shard = shard;
+    for (auto const& source : sources) {
+        auto path = std::filesystem::absolute(source).lexically_normal();
+        auto output_path = SourceFileHandler::outputPathFor(out_dir, path);
+
+        Output output { output_path.lexically_relative(out_dir).generic_string(), {} };
+        if (auto buffer = llvm::MemoryBuffer::getFile(output_path.string()))
+            output.content_hash = llvm::utohexstr(llvm::xxHash64(buffer.get()->getBuffer()));
+        manifest.outputs[path.lexically_relative(base_dir).generic_string()] = std::move(output);
+    }
+    return manifest;
+}
+
+std::optional<ShardManifest> ShardManifest::read(std::string const& path)
+{
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+        llvm::errs() << "Can't read shard manifest " << path << ": " << buffer.getError().message() << "\n";
+        return {};
+    }
+
+    auto json = llvm::json::parse(buffer.get()->getBuffer());
+    if (!json) {
+        llvm::errs() << "Malformed shard manifest " << path << ": " << json.takeError() << "\n";
+        return {};
+    }
+
+    auto const* root = json->getAsObject();
+    if (!root) {
+        llvm::errs() << "Malformed shard manifest " << path << "\n";
+        return {};
+    }
+    auto const* outputs = root->getObject("outputs");
+    auto index = root->getInteger("shard");
+    auto count = root->getInteger("count");
+    if (!outputs || !index || !count) {
+        llvm::errs() << "Malformed shard manifest " << path << "\n";
+        return {};
+    }
+    // Same rules as ShardSpec::parse(), as the index is used to look up the shard in its partition.
+    if (*index < 0 || *count <= 0 || *index >= *count || *count > std::numeric_limits<unsigned>::max()) {
+        llvm::errs() << "Invalid shard " << *index << "/" << *count << " in shard manifest " << path << ", expected i/N with 0 <= i < N\n";
+        return {};
+    }
+
+    ShardManifest manifest;
+    manifest.shard = { static_cast<unsigned>(*index), static_cast<unsigned>(*count) };
+    for (auto const& [header, value] : *outputs) {
+        auto const* fields = value.getAsObject();
+        if (!fields)
+            continue;
+        Output output;
+        if (auto output_path = fields->getString("output"))
+            output.output_path = output_path->str();
+        if (auto content_hash = fields->getString("hash"))
+            output.content_hash = content_hash->str();
+        manifest.outputs[header.str()] = std::move(output);
+    }
+    return manifest;
+}
+
+bool ShardManifest::write(std::string const& path) const
+{
+    llvm::json::Object json_outputs;
+    for (auto const& [header, output] : outputs) {
+        json_outputs[header] = llvm::json::Object {
+            { "output", output.output_path },
+            { "hash", output.content_hash },
+        };
+    }
+
+    // Renamed into place from a temporary file, so that --check-shards never reads a truncated manifest.
+    auto error = llvm::writeToOutput(path, [&](llvm::raw_ostream& os) {
+        os << llvm::json::Value(llvm::json::Object {
+            { "shard", shard.index },
+            { "count", shard.count },
+            { "outputs", std::move(json_outputs) },
+        });
+        return llvm::Error::success();
+    });
+    if (error) {
+        llvm::errs() << "Can't write shard manifest " << path << ": " << llvm::toString(std::move(error)) << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool checkShardsMatchFullRun(ShardManifest const& full_run, std::vector<ShardManifest> const& shards)
+{
+    bool ok = true;
+    auto fail = [&](auto const&... message) {
+        ok = false;
+        (llvm::errs() << ... << message) << "\n";
+    };
+
+    if (shards.empty()) {
+        fail("No shard manifests to check");
+        return ok;
+    }
+
+    auto count = shards.front().shard.count;
+    std::vector<bool> seen_shards(count, false);
+    for (auto const& manifest : shards) {
+        if (manifest.shard.count != count) {
+            fail("Shard ", manifest.shard.index, "/", manifest.shard.count, " is not from a ", count, "-way partition");
+            continue;
+        }
+        if (seen_shards[manifest.shard.index])
+            fail("Shard ", manifest.shard.index, "/", count, " was given more than once");
+        seen_shards[manifest.shard.index] = true;
+    }
+    for (unsigned i = 0; i < count; ++i) {
+        if (!seen_shards[i])
+            fail("Shard ", i, "/", count, " is missing");
+    }
+
+    std::map<std::string, ShardManifest::Output> combined;
+    for (auto const& manifest : shards) {
+        for (auto const& [header, output] : manifest.outputs) {
+            if (!combined.try_emplace(header, output).second)
+                fail(header, " is in more than one shard");
+        }
+    }
+
+    for (auto const& [header, output] : full_run.outputs) {
+        auto it = combined.find(header);
+        if (it == combined.end())
+            fail(header, " is not in any shard");
+        else if (it->second.output_path != output.output_path || it->second.content_hash != output.content_hash)
+            fail(header, " generated different bindings in its shard");
+    }
+    for (auto const& [header, output] : combined) {
+        if (!full_run.outputs.contains(header))
+            fail(header, " is in a shard, but not in the full run");
+    }
+
+    return ok;
+}
+
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <llvm/ADT/StringRef.h>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+struct ShardSpec {
+    unsigned index { 0 };
+    unsigned count { 1 };
+
+    // Parses "i/N", with 0 <= i < N.
+    static std::optional<ShardSpec> parse(llvm::StringRef spec);
+};
+
+// Deterministically picks the headers that belong to a shard. Every machine given the same header list and checkout
+// computes the same partition: headers are balanced across shards by file size, and ties are broken by their path
+// relative to the base directory, so neither the order on the command line nor the checkout location matters.
+std::vector<std::string> selectShard(std::vector<std::string> const& sources, std::filesystem::path const& base_dir, ShardSpec shard);
+
+// What a (possibly sharded) run produced: for each header relative to the base directory, its .jakt file relative to
+// the output directory and a hash of its contents.
+struct ShardManifest {
+    struct Output {
+        std::string output_path;
+        std::string content_hash;
+    };
+
+    ShardSpec shard;
+    std::map<std::string, Output> outputs;
+
+    static ShardManifest create(ShardSpec shard, std::vector<std::string> const& sources, std::filesystem::path const& base_dir, std::filesystem::path const& out_dir);
+    static std::optional<ShardManifest> read(std::string const& path);
+    bool write(std::string const& path) const;
+};
+
+// Checks that the given shard manifests are all N shards of one partition, cover disjoint sets of headers, and that
+// together they produced exactly the outputs of the full run. Prints every difference found.
+bool checkShardsMatchFullRun(ShardManifest const& full_run, std::vector<ShardManifest> const& shards);
+
+}
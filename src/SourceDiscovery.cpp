@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "SourceDiscovery.h"
+#include <algorithm>
+#include <cstring>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/GlobPattern.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace jakt_bindgen {
+
+static std::optional<std::vector<llvm::GlobPattern>> compileGlobs(std::vector<std::string> const& globs)
+{
+    std::vector<llvm::GlobPattern> patterns;
+    for (auto const& glob : globs) {
+        auto pattern = llvm::GlobPattern::create(glob);
+        if (!pattern) {
+            llvm::errs() << "Invalid glob " << glob << ": " << llvm::toString(pattern.takeError()) << "\n";
+            return {};
+        }
+        patterns.push_back(std::move(pattern.get()));
+    }
+    return patterns;
+}
+
+static bool matchesAny(std::vector<llvm::GlobPattern> const& patterns, llvm::StringRef path)
+{
+    return std::any_of(patterns.begin(), patterns.end(), [&](auto const& pattern) { return pattern.match(path); });
+}
+
+static bool isIdentifierCharacter(char c)
+{
+    return llvm::isAlnum(c) || c == '_' || c == ':';
+}
+
+// A textual check for "namespace GUI" or "namespace Foo::GUI" that's good enough to skip headers with nothing to bind.
+// It may let through a header that only mentions the namespace in a comment, but never rejects one that opens it.
+static bool mayOpenNamespace(llvm::StringRef contents, llvm::StringRef target_namespace)
+{
+    auto name = target_namespace.rsplit("::").second;
+    if (name.empty())
+        name = target_namespace;
+
+    for (auto position = contents.find("namespace"); position != llvm::StringRef::npos; position = contents.find("namespace", position + 1)) {
+        if (position > 0 && isIdentifierCharacter(contents[position - 1]))
+            continue;
+
+        auto rest = contents.drop_front(position + strlen("namespace"));
+        auto trimmed = rest.ltrim();
+        if (trimmed.size() == rest.size())
+            continue;
+
+        auto qualified_name = trimmed.take_while(isIdentifierCharacter);
+        if (qualified_name == name || qualified_name.endswith(("::" + name).str()))
+            return true;
+    }
+    return false;
+}
+
+std::optional<std::vector<std::string>> discoverSources(clang::tooling::CompilationDatabase const& compilations, DiscoveryOptions const& options)
+{
+    auto include_patterns = compileGlobs(options.include_globs);
+    auto exclude_patterns = compileGlobs(options.exclude_globs);
+    if (!include_patterns.has_value() || !exclude_patterns.has_value())
+        return {};
+
+    auto base_dir = options.base_dir.lexically_normal();
+
+    llvm::StringSet<> seen;
+    std::vector<std::string> candidates;
+    auto consider = [&](std::filesystem::path const& path) {
+        auto absolute_path = std::filesystem::absolute(path).lexically_normal();
+        auto relative_path = absolute_path.lexically_relative(base_dir).generic_string();
+        if (relative_path.empty() || relative_path.starts_with(".."))
+            return;
+        if (!matchesAny(*include_patterns, relative_path) || matchesAny(*exclude_patterns, relative_path))
+            return;
+        if (seen.insert(absolute_path.string()).second)
+            candidates.push_back(absolute_path.string());
+    };
+
+    std::error_code ec;
+    for (llvm::sys::fs::recursive_directory_iterator it(base_dir.string(), ec, /* follow_symlinks = */ false), end; it != end && !ec; it.increment(ec)) {
+        if (it->type() == llvm::sys::fs::file_type::regular_file)
+            consider(it->path());
+    }
+    if (ec)
+        llvm::errs() << "Error while walking " << base_dir.string() << ": " << ec.message() << "\n";
+
+    // Some compilation databases list headers as well. Those may live in generated directories outside of the walk.
+    for (auto const& file : compilations.getAllFiles())
+        consider(file);
+
+    std::vector<std::string> sources;
+    for (auto const& candidate : candidates) {
+        auto buffer = llvm::MemoryBuffer::getFile(candidate, /* IsText = */ true, /* RequiresNullTerminator = */ false);
+        if (!buffer) {
+            llvm::errs() << "Can't read " << candidate << ": " << buffer.getError().message() << "\n";
+            continue;
+        }
+        if (mayOpenNamespace((*buffer)->getBuffer(), options.target_namespace))
+            sources.push_back(candidate);
+    }
+
+    llvm::outs() << "Discovered " << sources.size() << " header(s) under " << base_dir.string() << ", skipped "
+                 << (candidates.size() - sources.size()) << " that don't open namespace " << options.target_namespace << "\n";
+
+    std::sort(sources.begin(), sources.end());
+    return sources;
+}
+
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <clang/Tooling/CompilationDatabase.h>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+struct DiscoveryOptions {
+    std::filesystem::path base_dir;
+    std::string target_namespace;
+
+    // Globs matched against paths relative to the base directory, e.g. "LibGUI/*.h". A '*' also matches '/'.
+    // A file is a candidate if it matches any of the include globs and none of the exclude globs.
+    std::vector<std::string> include_globs;
+    std::vector<std::string> exclude_globs;
+};
+
+// Finds the headers under the base directory, along with any headers the compilation database lists there,
+// that could contain something to bind. Files that never open the target namespace are left out without being parsed.
+// Returns sorted absolute paths, or nothing if a glob is invalid.
+std::optional<std::vector<std::string>> discoverSources(clang::tooling::CompilationDatabase const& compilations, DiscoveryOptions const& options);
+
+}
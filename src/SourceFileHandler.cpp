@@ -5,18 +5,38 @@
  */
 
 #include "SourceFileHandler.h"
+#include "ApiModel.h"
+#include "ApiModelBuilder.h"
+#include "Console.h"
 #include "JaktGenerator.h"
+#include "MemoryUsage.h"
+#include "SymbolIndex.h"
 #include <algorithm>
+#include <clang/AST/Decl.h>
+#include <clang/Frontend/CompilerInstance.h>
 #include <filesystem>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/TimeProfiler.h>
 #include <llvm/Support/raw_ostream.h>
+#include <mutex>
 #include <system_error>
 
+#define DEBUG_TYPE "source-file-handler"
+
 namespace jakt_bindgen {
 
+ALWAYS_ENABLED_STATISTIC(NumTranslationUnits, "Translation units processed");
+ALWAYS_ENABLED_STATISTIC(NumHeadersBound, "Headers bound");
+ALWAYS_ENABLED_STATISTIC(NumHeadersWithoutClasses, "Headers without any classes");
+ALWAYS_ENABLED_STATISTIC(NumBindingsGenerated, "Bindings generated");
+ALWAYS_ENABLED_STATISTIC(NumBytesGenerated, "Bytes of bindings generated");
+
 SourceFileHandler::SourceFileHandler(std::string namespace_, std::filesystem::path out_dir, std::filesystem::path base_dir)
     : m_out_dir(std::move(out_dir))
     , m_base_dir(std::move(base_dir))
-    , m_listener(std::move(namespace_), m_finder)
+    , m_listener(std::move(namespace_))
 {
 }
 
@@ -25,15 +45,33 @@ bool SourceFileHandler::handleBeginSource(clang::CompilerInstance& CI)
     if (!clang::tooling::SourceFileCallbacks::handleBeginSource(CI))
         return false;
 
-    auto main_file_id = CI.getSourceManager().getMainFileID();
-    auto maybe_path = CI.getSourceManager().getNonBuiltinFilenameForID(main_file_id);
-    if (!maybe_path.has_value())
-        return false;
+    m_current_headers.clear();
+    auto& source_manager = CI.getSourceManager();
+    if (m_umbrella_headers.empty()) {
+        auto main_file_id = source_manager.getMainFileID();
+        auto maybe_path = source_manager.getNonBuiltinFilenameForID(main_file_id);
+        if (!maybe_path.has_value())
+            return false;
 
-    m_current_filepath = std::filesystem::canonical(maybe_path.value().str()).lexically_relative(m_base_dir);
-    llvm::outs() << "Processing " << m_current_filepath.string() << "\n";
+        auto relative_path = std::filesystem::canonical(maybe_path.value().str()).lexically_relative(m_base_dir);
+        m_current_headers.push_back({ maybe_path.value().str(), relative_path, source_manager.getFileEntryForID(main_file_id) });
+    } else {
+        for (auto const& header : m_umbrella_headers) {
+            auto file = CI.getFileManager().getFile(header);
+            if (!file) {
+                std::scoped_lock lock(consoleMutex());
+                llvm::errs() << "Can't open header " << header << ": " << file.getError().message() << "\n";
+                continue;
+            }
+            auto relative_path = std::filesystem::canonical(header).lexically_relative(m_base_dir);
+            m_current_headers.push_back({ header, relative_path, file.get() });
+        }
+    }
 
-    m_listener.resetForNextFile();
+    beginBoundHeaders();
+
+    m_dependency_collector = std::make_shared<IncludeCollector>();
+    m_dependency_collector->attachToPreprocessor(CI.getPreprocessor());
 
     m_ci = &CI;
 
@@ -42,29 +80,234 @@ bool SourceFileHandler::handleBeginSource(clang::CompilerInstance& CI)
 
 void SourceFileHandler::handleEndSource()
 {
-    std::string base_name = m_current_filepath.filename().replace_extension(".jakt");
+    m_dependencies = m_dependency_collector->absoluteDependencies(m_ci->getFileManager());
+    m_context = &m_ci->getASTContext();
+
+    endBoundHeaders();
+}
+
+bool SourceFileHandler::processASTUnit(clang::ASTUnit& unit, std::string const& main_file, std::vector<std::string> dependencies)
+{
+    auto file = unit.getFileManager().getFile(main_file);
+    if (!file) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Can't find " << main_file << " in its AST: " << file.getError().message() << "\n";
+        return false;
+    }
+
+    m_current_headers.clear();
+    auto relative_path = std::filesystem::canonical(main_file).lexically_relative(m_base_dir);
+    m_current_headers.push_back({ main_file, relative_path, file.get() });
+    beginBoundHeaders();
+
+    // A loaded AST has no parse to listen to, but its translation unit lists the same top level declarations.
+    auto& context = unit.getASTContext();
+    auto const* translation_unit = context.getTranslationUnitDecl();
+    std::vector<clang::Decl const*> top_level_decls(translation_unit->decls_begin(), translation_unit->decls_end());
+    m_listener.collect(context, top_level_decls);
+
+    m_dependencies = std::move(dependencies);
+    m_context = &context;
+
+    endBoundHeaders();
+    return true;
+}
+
+void SourceFileHandler::beginBoundHeaders()
+{
+    {
+        std::scoped_lock lock(consoleMutex());
+        for (auto const& header : m_current_headers)
+            llvm::outs() << "Processing " << header.relative_path.string() << "\n";
+    }
+
+    std::vector<clang::FileEntry const*> bound_files;
+    for (auto const& header : m_current_headers)
+        bound_files.push_back(header.file);
+    m_listener.resetForNextFile();
+    m_listener.setBoundFiles(std::move(bound_files));
+
+    m_generated_files.clear();
+    m_deferred_bindings.clear();
+    m_dependencies.clear();
+    m_write_failed = false;
+
+    if (m_report_memory)
+        m_resident_at_begin = currentResidentSetSize();
+}
+
+void SourceFileHandler::endBoundHeaders()
+{
+    ++NumTranslationUnits;
+    for (auto const& header : m_current_headers)
+        generateBindings(header);
+
+    // Sampled while the AST is still alive, which is about as big as the process gets while processing this TU.
+    // The growth since the TU started is what it cost, unless other TUs were processed at the same time.
+    if (m_report_memory) {
+        constexpr int64_t mebibyte = 1024 * 1024;
+        auto resident = currentResidentSetSize();
+        std::scoped_lock lock(consoleMutex());
+        for (auto const& header : m_current_headers) {
+            llvm::outs() << "Memory after " << header.relative_path.string() << ": ";
+            if (!resident.has_value() || !m_resident_at_begin.has_value()) {
+                llvm::outs() << "unavailable\n";
+                continue;
+            }
+            auto growth = static_cast<int64_t>(*resident) - static_cast<int64_t>(*m_resident_at_begin);
+            llvm::outs() << static_cast<int64_t>(*resident) / mebibyte << " MiB resident, " << (growth < 0 ? "" : "+") << growth / mebibyte << " MiB since it started\n";
+        }
+    }
+
+    // Nothing may point into the AST once it's gone.
+    m_listener.resetForNextFile();
+    m_context = nullptr;
+}
+
+std::filesystem::path SourceFileHandler::outputPathFor(std::filesystem::path const& out_dir, std::filesystem::path const& header_path)
+{
+    std::string base_name = header_path.filename().replace_extension(".jakt");
     std::transform(base_name.begin(), base_name.end(), base_name.begin(),
         [](unsigned char c) { return std::tolower(c); });
 
-    std::string new_filename = (m_out_dir / base_name).string();
+    return out_dir / base_name;
+}
+
+std::filesystem::path SourceFileHandler::apiModelPathFor(std::filesystem::path const& output_path)
+{
+    return std::filesystem::path(output_path).replace_extension(".api.json");
+}
 
-    std::error_code os_errc = {};
-    llvm::raw_fd_ostream os(new_filename, os_errc, llvm::sys::fs::CD_CreateAlways);
-    if (os_errc) {
-        llvm::errs() << "Can't open file " << new_filename << ": " << os_errc.message() << "\n";
+std::filesystem::path SourceFileHandler::depfilePathFor(std::filesystem::path const& output_path)
+{
+    return std::filesystem::path(output_path) += ".d";
+}
+
+void SourceFileHandler::generateBindings(BoundHeader const& header)
+{
+    std::string new_filename = outputPathFor(m_out_dir, header.relative_path).string();
+    ++NumHeadersBound;
+
+    if (m_listener.tag_decls(header.file).empty()) {
+        ++NumHeadersWithoutClasses;
+        {
+            std::scoped_lock lock(consoleMutex());
+            llvm::errs() << "No classes found in " << header.relative_path.string() << "?\n";
+        }
+        // Headers without any classes still get an (empty) file, which the cache records like any other.
+        if (auto error = m_output->write(new_filename, {})) {
+            std::scoped_lock lock(consoleMutex());
+            llvm::errs() << "Can't write file " << new_filename << ": " << llvm::toString(std::move(error)) << "\n";
+            m_write_failed = true;
+            return;
+        }
+        m_generated_files.push_back({ header.absolute_path, new_filename, true });
         return;
     }
 
-    if (m_listener.tag_decls().empty()) {
-        llvm::errs() << "No classes found?\n";
+    ApiHeader model;
+    {
+        llvm::TimeTraceScope scope("BuildApiModel", header.relative_path.string());
+        model = ApiModelBuilder(m_listener, *m_context).build(header.file, header.relative_path.string());
+    }
+
+    if (m_symbol_index) {
+        m_symbol_index->update(model);
+        m_deferred_bindings.push_back({ std::move(model), new_filename });
+    } else if (!writeBindings(model, new_filename, { .type_map = *m_type_map, .output = *m_output, .emit_api_model = m_emit_api_model, .generation_pool = m_generation_pool })) {
+        m_write_failed = true;
         return;
     }
 
-    JaktGenerator generator(os, m_listener);
+    m_generated_files.push_back({ header.absolute_path, new_filename });
+}
+
+bool SourceFileHandler::writeBindings(ApiHeader const& model, std::string const& output_path, WriteOptions const& options)
+{
+    llvm::TimeTraceScope scope("GenerateBindings", model.header_path);
+
+    // A model that can't be written is an error, but the binding itself is still written.
+    bool wrote_model = true;
+    if (options.emit_api_model) {
+        auto model_path = apiModelPathFor(output_path).string();
+        std::string json;
+        llvm::raw_string_ostream json_os(json);
+        model.write(json_os);
+        if (auto error = options.output.write(model_path, json_os.str())) {
+            std::scoped_lock lock(consoleMutex());
+            llvm::errs() << "Can't write API model " << model_path << ": " << llvm::toString(std::move(error)) << "\n";
+            wrote_model = false;
+        }
+    }
+
+    // Render to memory first, so that a failed generation never leaves a truncated file behind,
+    // and so that unchanged output can leave the file on disk (and its mtime) alone.
+    std::string contents;
+    llvm::raw_string_ostream os(contents);
+    JaktGenerator generator(os, model, options.type_map);
+    // Resolved for this binding only. The model, and the API model written above, keep the imports of its bases.
+    std::vector<ApiImport> resolved_imports;
+    if (options.symbol_index) {
+        resolved_imports = options.symbol_index->resolveImports(model);
+        generator.setImports(resolved_imports);
+    }
+    generator.generate(options.generation_pool);
+    if (!generator.unsupportedTemplates().empty()) {
+        std::scoped_lock lock(consoleMutex());
+        for (auto const& spelling : generator.unsupportedTemplates())
+            llvm::errs() << "Saw an NTTP in " << spelling << ", can't do that yet :(\n";
+    }
+    ++NumBindingsGenerated;
+    NumBytesGenerated += os.str().size();
 
-    static_cast<clang::tooling::SourceFileCallbacks&>(generator).handleBeginSource(*m_ci);
-    generator.generate(m_current_filepath.string());
-    static_cast<clang::tooling::SourceFileCallbacks&>(generator).handleEndSource();
+    if (auto error = options.output.write(output_path, os.str())) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Can't write file " << output_path << ": " << llvm::toString(std::move(error)) << "\n";
+        return false;
+    }
+    return wrote_model;
+}
+
+// Escapes a path the way GCC does in the depfiles it writes, which is what both Make and Ninja expect.
+static void appendDepfilePath(std::string& depfile, llvm::StringRef path)
+{
+    for (size_t i = 0; i < path.size(); ++i) {
+        char c = path[i];
+        if (c == ' ') {
+            // Backslashes only escape themselves when they precede a space.
+            for (size_t j = i; j > 0 && path[j - 1] == '\\'; --j)
+                depfile += '\\';
+            depfile += '\\';
+        } else if (c == '#') {
+            depfile += '\\';
+        } else if (c == '$') {
+            depfile += '$';
+        }
+        depfile += c;
+    }
+}
+
+bool SourceFileHandler::writeDepfile(OutputSink& output, std::string const& output_path, std::vector<std::string> const& inputs)
+{
+    std::string depfile;
+    appendDepfilePath(depfile, output_path);
+    depfile += ":";
+    llvm::StringSet<> listed;
+    for (auto const& input : inputs) {
+        if (!listed.insert(input).second)
+            continue;
+        depfile += " \\\n  ";
+        appendDepfilePath(depfile, input);
+    }
+    depfile += "\n";
+
+    auto depfile_path = depfilePathFor(output_path).string();
+    if (auto error = output.write(depfile_path, depfile)) {
+        std::scoped_lock lock(consoleMutex());
+        llvm::errs() << "Can't write depfile " << depfile_path << ": " << llvm::toString(std::move(error)) << "\n";
+        return false;
+    }
+    return true;
 }
 
 }
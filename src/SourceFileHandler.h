@@ -6,14 +6,30 @@
 
 #pragma once
 
+#include "ApiModel.h"
 #include "CXXClassListener.h"
-#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include "IncludeCollector.h"
+#include "OutputSink.h"
+#include <clang/AST/ASTContext.h>
+#include <clang/Frontend/ASTUnit.h>
 #include <clang/Tooling/Tooling.h>
 #include <filesystem>
 #include <llvm/Support/raw_ostream.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class ThreadPool;
+}
 
 namespace jakt_bindgen {
 
+class SymbolIndex;
+class TypeMap;
+
 class SourceFileHandler : public clang::tooling::SourceFileCallbacks {
 public:
     SourceFileHandler(std::string namespace_, std::filesystem::path out_dir, std::filesystem::path base_dir);
@@ -21,16 +37,115 @@ public:
     virtual bool handleBeginSource(clang::CompilerInstance&) override;
     virtual void handleEndSource() override;
 
-    clang::ast_matchers::MatchFinder& finder() { return m_finder; }
+    CXXClassListener& listener() { return m_listener; }
+
+    // Processes a header that was parsed up front, or loaded from an AST snapshot, instead of through a frontend action.
+    // The include closure can't be collected while preprocessing then, so it has to be passed in.
+    bool processASTUnit(clang::ASTUnit& unit, std::string const& main_file, std::vector<std::string> dependencies);
+
+    // The .jakt file written for a header: its lowercased file name, in the output directory.
+    static std::filesystem::path outputPathFor(std::filesystem::path const& out_dir, std::filesystem::path const& header_path);
+
+    // When set, the main file of each TU is a synthesized umbrella that includes these headers (by absolute path),
+    // and one .jakt file is written per header instead of one for the main file.
+    void setUmbrellaHeaders(std::vector<std::string> headers) { m_umbrella_headers = std::move(headers); }
+
+    // When set, the API model each binding is generated from is also written next to it, as <output>.api.json.
+    void setEmitApiModel(bool emit_api_model) { m_emit_api_model = emit_api_model; }
+
+    // When set, the resident set size of the process is printed after each TU.
+    void setReportMemory(bool report_memory) { m_report_memory = report_memory; }
+
+    // The API model file written next to the .jakt file for a header.
+    static std::filesystem::path apiModelPathFor(std::filesystem::path const& output_path);
+
+    // The Make-style depfile written next to the .jakt file for a header, as <output>.d.
+    static std::filesystem::path depfilePathFor(std::filesystem::path const& output_path);
+
+    // When set, the types bound by each header are added to the index, and generating bindings is deferred until
+    // the caller has indexed every header of the run: any of them may provide an import for any other.
+    void setSymbolIndex(SymbolIndex* symbol_index) { m_symbol_index = symbol_index; }
+
+    // How C++ types are spelled in the bindings. Has to be set before the first TU is processed.
+    void setTypeMap(TypeMap const* type_map) { m_type_map = type_map; }
+
+    // When set, the tags of a header are rendered concurrently on this pool. The output is the same either way.
+    void setGenerationPool(llvm::ThreadPool* generation_pool) { m_generation_pool = generation_pool; }
+
+    // Where the generated files go. Defaults to writing them to disk.
+    void setOutputSink(OutputSink* output) { m_output = output; }
+
+    struct DeferredBinding {
+        ApiHeader model;
+        std::string output_path;
+    };
+
+    // The bindings of the last processed TU that still have to be written with writeBindings().
+    std::vector<DeferredBinding> takeDeferredBindings() { return std::exchange(m_deferred_bindings, {}); }
+
+    struct WriteOptions {
+        TypeMap const& type_map;
+        OutputSink& output;
+        // Imports are resolved against the index if one is given.
+        SymbolIndex const* symbol_index { nullptr };
+        bool emit_api_model { false };
+        llvm::ThreadPool* generation_pool { nullptr };
+    };
+
+    // Writes the .jakt file for a model.
+    // Doesn't involve Clang at all, so it also works for models read back from disk.
+    static bool writeBindings(ApiHeader const& model, std::string const& output_path, WriteOptions const& options);
+
+    // Writes the depfile of a .jakt file, listing each input once in the order given.
+    static bool writeDepfile(OutputSink& output, std::string const& output_path, std::vector<std::string> const& inputs);
+
+    struct GeneratedFile {
+        std::string header_path;
+        std::string output_path;
+        // The header has no classes, so the file is empty and there's no model.
+        bool is_empty { false };
+    };
+
+    // The .jakt files written for the last processed TU.
+    std::vector<GeneratedFile> const& generated_files() const { return m_generated_files; }
+
+    // Whether a binding (or its API model) of the last processed TU couldn't be written.
+    bool write_failed() const { return m_write_failed; }
+
+    // Absolute paths of every file the last processed TU pulled in, including its main file.
+    std::vector<std::string> const& dependencies() const { return m_dependencies; }
 
 private:
-    std::filesystem::path m_current_filepath;
+    struct BoundHeader {
+        std::string absolute_path;
+        std::filesystem::path relative_path;
+        clang::FileEntry const* file { nullptr };
+    };
+
+    void beginBoundHeaders();
+    void endBoundHeaders();
+    void generateBindings(BoundHeader const& header);
+
+    std::vector<std::string> m_umbrella_headers;
+    std::vector<BoundHeader> m_current_headers;
+    std::vector<GeneratedFile> m_generated_files;
+    std::vector<DeferredBinding> m_deferred_bindings;
+    std::vector<std::string> m_dependencies;
+    std::shared_ptr<IncludeCollector> m_dependency_collector;
+    bool m_emit_api_model { false };
+    bool m_report_memory { false };
+    bool m_write_failed { false };
+    std::optional<size_t> m_resident_at_begin;
+    SymbolIndex* m_symbol_index { nullptr };
+    TypeMap const* m_type_map { nullptr };
+    llvm::ThreadPool* m_generation_pool { nullptr };
+    OutputSink* m_output { &OutputSink::files() };
     std::filesystem::path m_out_dir;
     std::filesystem::path m_base_dir;
 
-    clang::ast_matchers::MatchFinder m_finder;
     CXXClassListener m_listener;
     clang::CompilerInstance* m_ci { nullptr };
+    clang::ASTContext* m_context { nullptr };
 };
 
 }
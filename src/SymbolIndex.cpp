@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "SymbolIndex.h"
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace jakt_bindgen {
+
+// Bump this whenever the layout of the index changes.
+static constexpr int64_t s_index_version = 1;
+
+static void collectExports(std::vector<ApiTag> const& tags, std::string const& scope, ApiImport const* outermost, std::vector<ApiImport>& imports,
+    std::vector<std::string>& qualified_names)
+{
+    for (auto const& tag : tags) {
+        auto const& name = tag.class_.has_value() ? tag.class_->name : tag.enum_->name;
+        auto qualified_name = scope + "::" + name;
+        auto import = outermost ? *outermost : ApiImport { scope, name };
+
+        qualified_names.push_back(qualified_name);
+        imports.push_back(import);
+
+        if (tag.class_.has_value())
+            collectExports(tag.class_->nested_tags, qualified_name, &import, imports, qualified_names);
+    }
+}
+
+SymbolIndex::SymbolIndex(std::filesystem::path path)
+    : m_path(std::move(path))
+{
+}
+
+std::unique_ptr<SymbolIndex> SymbolIndex::open(std::filesystem::path path)
+{
+    auto index = std::unique_ptr<SymbolIndex>(new SymbolIndex(std::move(path)));
+    if (!index->load())
+        return nullptr;
+    return index;
+}
+
+bool SymbolIndex::load()
+{
+    if (!std::filesystem::exists(m_path))
+        return true;
+
+    auto buffer = llvm::MemoryBuffer::getFile(m_path.string());
+    if (!buffer) {
+        llvm::errs() << "Can't read symbol index " << m_path.string() << ": " << buffer.getError().message() << "\n";
+        return false;
+    }
+
+    auto index = llvm::json::parse(buffer.get()->getBuffer());
+    if (!index) {
+        llvm::errs() << "Malformed symbol index " << m_path.string() << ": " << index.takeError() << "\n";
+        return false;
+    }
+
+    // An index from another version is rebuilt from scratch by the headers processed in this run.
+    auto const* root = index->getAsObject();
+    if (!root || root->getInteger("version") != s_index_version)
+        return true;
+    auto const* headers = root->getObject("headers");
+    if (!headers)
+        return true;
+
+    for (auto const& [header_path, value] : *headers) {
+        auto const* symbols = value.getAsArray();
+        if (!symbols)
+            continue;
+        for (auto const& symbol_value : *symbols) {
+            auto const* fields = symbol_value.getAsObject();
+            if (!fields)
+                continue;
+            auto qualified_name = fields->getString("symbol");
+            auto namespace_name = fields->getString("namespace");
+            auto name = fields->getString("name");
+            if (!qualified_name || !namespace_name || !name)
+                continue;
+            addSymbol({ qualified_name->str(), header_path.str(), { namespace_name->str(), name->str() } });
+        }
+    }
+    return true;
+}
+
+void SymbolIndex::addSymbol(Symbol symbol)
+{
+    // A type that moved between headers is only bound by the header that was processed last.
+    if (auto existing = m_symbols.find(symbol.qualified_name); existing != m_symbols.end() && existing->getValue().header_path != symbol.header_path)
+        std::erase(m_symbols_by_header[existing->getValue().header_path], symbol.qualified_name);
+
+    m_symbols_by_header[symbol.header_path].push_back(symbol.qualified_name);
+    auto qualified_name = symbol.qualified_name;
+    m_symbols[qualified_name] = std::move(symbol);
+}
+
+void SymbolIndex::update(ApiHeader const& header)
+{
+    std::vector<ApiImport> imports;
+    std::vector<std::string> qualified_names;
+    collectExports(header.tags, header.namespace_name, nullptr, imports, qualified_names);
+
+    std::scoped_lock lock(m_lock);
+    if (auto it = m_symbols_by_header.find(header.header_path); it != m_symbols_by_header.end()) {
+        for (auto const& qualified_name : it->getValue())
+            m_symbols.erase(qualified_name);
+        m_symbols_by_header.erase(it);
+    }
+
+    for (size_t i = 0; i < qualified_names.size(); ++i)
+        addSymbol({ std::move(qualified_names[i]), header.header_path, std::move(imports[i]) });
+}
+
+std::vector<ApiImport> SymbolIndex::resolveImports(ApiHeader const& header) const
+{
+    std::vector<ApiImport> imports;
+    llvm::StringSet<> imported;
+
+    std::scoped_lock lock(m_lock);
+    // Bases from headers that aren't bound with this index (e.g. Core::Object) are only known to the model itself.
+    for (auto const& import : header.imports) {
+        auto qualified_name = import.namespace_name + "::" + import.name;
+        if (!m_symbols.count(qualified_name) && imported.insert(qualified_name).second)
+            imports.push_back(import);
+    }
+    for (auto const& qualified_name : header.referenced_types) {
+        auto it = m_symbols.find(qualified_name);
+        if (it == m_symbols.end() || it->getValue().header_path == header.header_path)
+            continue;
+
+        auto const& import = it->getValue().import;
+        if (imported.insert(import.namespace_name + "::" + import.name).second)
+            imports.push_back(import);
+    }
+    return imports;
+}
+
+bool SymbolIndex::save() const
+{
+    llvm::json::Object headers;
+    {
+        std::scoped_lock lock(m_lock);
+        for (auto const& header : m_symbols_by_header) {
+            llvm::json::Array symbols;
+            for (auto const& qualified_name : header.getValue()) {
+                auto const& symbol = m_symbols.find(qualified_name)->getValue();
+                symbols.push_back(llvm::json::Object {
+                    { "symbol", symbol.qualified_name },
+                    { "namespace", symbol.import.namespace_name },
+                    { "name", symbol.import.name },
+                });
+            }
+            headers[header.getKey()] = std::move(symbols);
+        }
+    }
+
+    // Written to a temporary file that's renamed over the index, so that an interrupted run can't leave a truncated index behind.
+    auto error = llvm::writeToOutput(m_path.string(), [&](llvm::raw_ostream& os) {
+        os << llvm::json::Value(llvm::json::Object { { "version", s_index_version }, { "headers", std::move(headers) } });
+        return llvm::Error::success();
+    });
+    if (error) {
+        llvm::errs() << "Can't write symbol index " << m_path.string() << ": " << llvm::toString(std::move(error)) << "\n";
+        return false;
+    }
+    return true;
+}
+
+}
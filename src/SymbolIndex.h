@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include "ApiModel.h"
+#include <filesystem>
+#include <llvm/ADT/StringMap.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+// Maps every type that has a binding to the header that binds it, and to the import that brings it into scope.
+// It's kept on disk and updated with the headers processed by each run, so that headers that aren't processed
+// again (or aren't part of this run at all) can still be imported from.
+class SymbolIndex {
+public:
+    // An index that doesn't exist yet starts out empty.
+    static std::unique_ptr<SymbolIndex> open(std::filesystem::path path);
+
+    // Replaces everything previously exported by the same header with the tags of the model.
+    void update(ApiHeader const& header);
+
+    // The imports of the header: exactly the indexed types it references that are bound by other headers,
+    // along with the imports of its model of types that aren't in the index. The model itself is left alone,
+    // so that it can be resolved again once other headers start or stop binding a type.
+    std::vector<ApiImport> resolveImports(ApiHeader const& header) const;
+
+    bool save() const;
+
+private:
+    explicit SymbolIndex(std::filesystem::path path);
+
+    bool load();
+
+    struct Symbol {
+        // The fully qualified name of the type, e.g. "GUI::Button::Mode".
+        std::string qualified_name;
+        std::string header_path;
+        // A nested type is imported along with its outermost enclosing class.
+        ApiImport import;
+    };
+
+    void addSymbol(Symbol symbol);
+
+    std::filesystem::path m_path;
+
+    mutable std::mutex m_lock;
+    llvm::StringMap<Symbol> m_symbols;
+    llvm::StringMap<std::vector<std::string>> m_symbols_by_header;
+};
+
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "TypeMap.h"
+#include <cctype>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+namespace jakt_bindgen {
+
+// Same format as a mapping file passed with --type-map.
+static constexpr char const s_default_type_map[] = R"({
+    "builtins": {
+        "void": "void",
+        "bool": "bool",
+        "_Bool": "bool",
+        "char": "c_char",
+        "signed char": "i8",
+        "unsigned char": "u8",
+        "wchar_t": "c_char",
+        "char8_t": "i8",
+        "char16_t": "i16",
+        "char32_t": "i32",
+        "unsigned short": "u16",
+        "short": "i16",
+        "unsigned int": "c_int",
+        "unsigned long": "c_int",
+        "unsigned long long": "c_int",
+        "unsigned __int128": "c_int",
+        "int": "c_int",
+        "long": "c_int",
+        "long long": "c_int",
+        "__int128": "c_int",
+        "float": "f32",
+        "double": "f64",
+        "long double": "f64",
+        "nullptr_t": "raw void",
+        "std::nullptr_t": "raw void"
+    },
+    "records": {
+        "AK::StringView": "StringView",
+        "AK::DeprecatedString": "String"
+    },
+    "templates": {
+        "AK::ErrorOr": { "rule": "error_or" },
+        "AK::Function": { "rule": "function" },
+        "AK::NonnullRefPtr": "{0}",
+        "AK::Optional": "{0}?",
+        "AK::DynamicArray": "[{0}]",
+        "Jakt::Dictionary": "[{0}:{1}]",
+        "AK::WeakPtr": "weak {0}?"
+    },
+    "hidden_bases": [
+        "AK::RefCounted",
+        "AK::Weakable"
+    ]
+})";
+
+static std::optional<TemplateMapping> parsePattern(llvm::StringRef pattern)
+{
+    TemplateMapping mapping;
+    std::string text;
+    while (!pattern.empty()) {
+        auto open = pattern.find('{');
+        text += pattern.take_front(open).str();
+        if (open == llvm::StringRef::npos)
+            break;
+
+        pattern = pattern.drop_front(open + 1);
+        auto close = pattern.find('}');
+        unsigned argument = 0;
+        if (close == llvm::StringRef::npos || pattern.take_front(close).getAsInteger(10, argument))
+            return {};
+        mapping.pieces.push_back({ std::move(text), argument });
+        text.clear();
+        pattern = pattern.drop_front(close + 1);
+    }
+    if (!text.empty())
+        mapping.pieces.push_back({ std::move(text), {} });
+    return mapping;
+}
+
+std::unique_ptr<TypeMap> TypeMap::createDefault()
+{
+    auto type_map = std::unique_ptr<TypeMap>(new TypeMap);
+    if (!type_map->add(s_default_type_map, "the default type map"))
+        llvm::report_fatal_error("The default type map is malformed", false);
+    return type_map;
+}
+
+std::unique_ptr<TypeMap> TypeMap::load(std::string const& path)
+{
+    auto buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+        llvm::errs() << "Can't read type map " << path << ": " << buffer.getError().message() << "\n";
+        return nullptr;
+    }
+
+    auto type_map = createDefault();
+    if (!type_map->add(buffer.get()->getBuffer(), path))
+        return nullptr;
+    type_map->m_fingerprint = llvm::utohexstr(llvm::xxHash64(buffer.get()->getBuffer()));
+    return type_map;
+}
+
+bool TypeMap::add(llvm::StringRef json, llvm::StringRef source)
+{
+    auto fail = [&](llvm::Twine const& error) {
+        llvm::errs() << "Malformed type map " << source << ": " << error << "\n";
+        return false;
+    };
+
+    auto parsed = llvm::json::parse(json);
+    if (!parsed) {
+        auto error = llvm::toString(parsed.takeError());
+        return fail(error);
+    }
+    auto const* root = parsed->getAsObject();
+    if (!root)
+        return fail("expected an object");
+
+    auto add_spellings = [&](char const* section, llvm::StringMap<std::string>& spellings) {
+        auto const* object = root->getObject(section);
+        if (!object)
+            return root->get(section) == nullptr || fail(llvm::Twine(section) + " must be an object");
+        for (auto const& [key, value] : *object) {
+            llvm::StringRef name = key;
+            auto spelling = value.getAsString();
+            if (!spelling)
+                return fail("the mapping of " + name + " must be a string");
+            spellings[name] = spelling->str();
+        }
+        return true;
+    };
+
+    if (!add_spellings("builtins", m_builtins) || !add_spellings("records", m_records))
+        return false;
+
+    if (auto const* templates = root->getObject("templates")) {
+        for (auto const& [key, value] : *templates) {
+            llvm::StringRef name = key;
+            std::optional<TemplateMapping> mapping;
+            if (auto pattern = value.getAsString()) {
+                mapping = parsePattern(*pattern);
+                if (!mapping.has_value())
+                    return fail("the pattern of " + name + " is malformed, use {N} for the N-th template argument");
+            } else if (auto const* object = value.getAsObject(); object && object->getString("rule")) {
+                auto rule = *object->getString("rule");
+                mapping.emplace();
+                if (rule == "error_or")
+                    mapping->rule = TemplateMapping::Rule::ErrorOr;
+                else if (rule == "function")
+                    mapping->rule = TemplateMapping::Rule::Function;
+                else
+                    return fail("unknown rule " + rule + " for " + name);
+            } else {
+                return fail("the mapping of " + name + " must be a pattern or a rule");
+            }
+            m_templates[name] = std::move(mapping.value());
+        }
+    } else if (root->get("templates")) {
+        return fail("templates must be an object");
+    }
+
+    if (auto const* hidden_bases = root->getArray("hidden_bases")) {
+        for (auto const& value : *hidden_bases) {
+            auto name = value.getAsString();
+            if (!name)
+                return fail("hidden_bases must be a list of names");
+            m_hidden_bases.insert(*name);
+        }
+    } else if (root->get("hidden_bases")) {
+        return fail("hidden_bases must be a list of names");
+    }
+
+    return true;
+}
+
+std::optional<llvm::StringRef> TypeMap::builtin(llvm::StringRef name) const
+{
+    if (auto it = m_builtins.find(name); it != m_builtins.end())
+        return llvm::StringRef(it->getValue());
+    return {};
+}
+
+std::optional<llvm::StringRef> TypeMap::record(llvm::StringRef qualified_name) const
+{
+    if (auto it = m_records.find(qualified_name); it != m_records.end())
+        return llvm::StringRef(it->getValue());
+    return {};
+}
+
+TemplateMapping const* TypeMap::templateMapping(llvm::StringRef qualified_name) const
+{
+    if (auto it = m_templates.find(qualified_name); it != m_templates.end())
+        return &it->getValue();
+    return nullptr;
+}
+
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2022, Andrew Kaster <akaster@serenityos.org>
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace jakt_bindgen {
+
+// How a class template specialization is spelled in Jakt.
+struct TemplateMapping {
+    enum class Rule {
+        // Spelled by the pattern, e.g. "[{0}:{1}]" for a dictionary.
+        Pattern,
+        // The result type of a throwing function: unwrapped to its first argument in return types.
+        ErrorOr,
+        // A callable wrapping a function type, spelled as a Jakt function type.
+        Function,
+    };
+
+    struct Piece {
+        std::string text;
+        // The template argument spelled after the text, if any.
+        std::optional<unsigned> argument;
+    };
+
+    Rule rule { Rule::Pattern };
+    std::vector<Piece> pieces;
+};
+
+// The mapping from C++ types to their Jakt spelling, keyed by qualified name (builtins by their C++ spelling).
+// The defaults cover AK and Jakt's runtime; a mapping file can add project specific types or override any of them.
+// Both are compiled into hash tables up front, so looking up a type costs the same no matter how many mappings there are.
+class TypeMap {
+public:
+    static std::unique_ptr<TypeMap> createDefault();
+
+    // The defaults, with the mappings of the file on top.
+    static std::unique_ptr<TypeMap> load(std::string const& path);
+
+    std::optional<llvm::StringRef> builtin(llvm::StringRef name) const;
+    std::optional<llvm::StringRef> record(llvm::StringRef qualified_name) const;
+    TemplateMapping const* templateMapping(llvm::StringRef qualified_name) const;
+
+    // Bases that are implementation details in C++ and left out of the bindings, e.g. AK::RefCounted.
+    bool isHiddenBase(llvm::StringRef qualified_name) const { return m_hidden_bases.contains(qualified_name); }
+
+    // Identifies the mapping file, for cache keys. Empty for the defaults.
+    std::string const& fingerprint() const { return m_fingerprint; }
+
+private:
+    TypeMap() = default;
+
+    bool add(llvm::StringRef json, llvm::StringRef source);
+
+    llvm::StringMap<std::string> m_builtins;
+    llvm::StringMap<std::string> m_records;
+    llvm::StringMap<TemplateMapping> m_templates;
+    llvm::StringSet<> m_hidden_bases;
+    std::string m_fingerprint;
+};
+
+}
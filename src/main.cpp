@@ -4,15 +4,21 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
-#include "SourceFileHandler.h"
+#include "JaktBindgen.h"
+#include "MemoryUsage.h"
+#include "Sharding.h"
+#include "SourceDiscovery.h"
 
-#include <clang/ASTMatchers/ASTMatchFinder.h>
-#include <clang/ASTMatchers/ASTMatchers.h>
 #include <clang/Tooling/CommonOptionsParser.h>
-#include <clang/Tooling/Tooling.h>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/TimeProfiler.h>
 
 #include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
 
 // Apply a custom category to all command-line options so that they are the
 // only ones displayed.
@@ -23,33 +29,295 @@ static llvm::cl::OptionCategory s_tool_category("jakt-bindgen options");
 // It's nice to have this help message in all tools.
 static llvm::cl::extrahelp s_common_help(clang::tooling::CommonOptionsParser::HelpMessage);
 
+// The options of CommonOptionsParser, which we parse ourselves so that the compilation database can be loaded
+// through its index (see --compdb-index), or not at all when it isn't needed.
+static llvm::cl::opt<std::string> s_build_path("p", llvm::cl::desc("Build path"),
+    llvm::cl::Optional,
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::list<std::string> s_source_paths(llvm::cl::Positional, llvm::cl::desc("<source0> [... <sourceN>]"),
+    llvm::cl::ZeroOrMore,
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::list<std::string> s_extra_args("extra-arg", llvm::cl::desc("Additional argument to append to the compiler command line"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::list<std::string> s_extra_args_before("extra-arg-before", llvm::cl::desc("Additional argument to prepend to the compiler command line"),
+    llvm::cl::cat(s_tool_category));
+
 // A help message for this specific tool can be added afterwards.
 static llvm::cl::extrahelp s_more_help("\nMore help text...\n");
 
 static llvm::cl::opt<std::string> s_target_namespace("n", llvm::cl::desc("Specify namespace to import names from"),
     llvm::cl::value_desc("namespace"),
-    llvm::cl::Required);
+    llvm::cl::Required,
+    llvm::cl::cat(s_tool_category));
 
 static llvm::cl::opt<std::string> s_base_path("b", llvm::cl::desc("Specify base path to use to determine import paths"),
     llvm::cl::value_desc("base"),
-    llvm::cl::Required);
+    llvm::cl::Required,
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<unsigned> s_jobs("j", llvm::cl::desc("Number of headers to process in parallel (0 to use all available cores)"),
+    llvm::cl::value_desc("jobs"),
+    llvm::cl::init(1),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<std::string> s_cache_dir("cache-dir", llvm::cl::desc("Directory to keep an incremental build manifest in. Headers whose inputs are unchanged since the last run are skipped"),
+    llvm::cl::value_desc("directory"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<std::string> s_ast_cache_dir("ast-cache", llvm::cl::desc("Directory to keep serialized ASTs of the headers in. Headers whose compile command and includes are unchanged are loaded from there instead of being parsed, regardless of the other options"),
+    llvm::cl::value_desc("directory"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::list<std::string> s_precompiled_includes("pch-include", llvm::cl::desc("Header shared by most inputs to precompile once and reuse for every header (e.g. AK/RefCounted.h)"),
+    llvm::cl::value_desc("header"),
+    llvm::cl::CommaSeparated,
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<bool> s_umbrella("umbrella", llvm::cl::desc("Parse all headers as one translation unit per job instead of one translation unit per header. Every header must be compilable with the same flags"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<std::string> s_time_trace("time-trace", llvm::cl::desc("Write a Chrome trace event file (viewable in chrome://tracing or Perfetto) with the time spent in each phase of each header"),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<bool> s_memory_report("memory-report", llvm::cl::desc("Print the resident set size after each header, and the peak resident set size of the whole run at the end"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<bool> s_fs_cache_report("fs-cache-report", llvm::cl::desc("Print how many file stats and reads were answered from the file system cache shared by all headers of a run"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<bool> s_stats("stats", llvm::cl::desc("Print counts of what the run did (translation units, classes, methods, skipped methods, type rewrites, bytes written, ...) at exit"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<std::string> s_stats_json("stats-json", llvm::cl::desc("Write the counts of --stats to this file as JSON"),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<bool> s_watch("watch", llvm::cl::desc("Keep running, and regenerate the bindings of every header whose contents or includes change"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<bool> s_discover("discover", llvm::cl::desc("Bind every header under the base path (-b) that matches --include and not --exclude, in addition to any listed headers"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::list<std::string> s_include_globs("include", llvm::cl::desc("Glob, relative to the base path, of headers to bind with --discover (default: *.h)"),
+    llvm::cl::value_desc("glob"),
+    llvm::cl::CommaSeparated,
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::list<std::string> s_exclude_globs("exclude", llvm::cl::desc("Glob, relative to the base path, of headers to skip with --discover"),
+    llvm::cl::value_desc("glob"),
+    llvm::cl::CommaSeparated,
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<std::string> s_shard("shard", llvm::cl::desc("Only process shard i of a deterministic N-way partition of the headers"),
+    llvm::cl::value_desc("i/N"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<std::string> s_shard_manifest("shard-manifest", llvm::cl::desc("After the run, write the headers processed and a hash of their bindings to this file"),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::list<std::string> s_check_shards("check-shards", llvm::cl::desc("After the run, check that the union of these shard manifests has exactly the bindings this run generated"),
+    llvm::cl::value_desc("manifest"),
+    llvm::cl::CommaSeparated,
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<bool> s_emit_api_model("emit-api-model", llvm::cl::desc("Also write the API model each binding is generated from, as <binding>.api.json"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<std::string> s_symbol_index("symbol-index", llvm::cl::desc("File mapping each bound type to its header, kept up to date across runs. When given, each binding imports exactly the bound types it uses"),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<std::string> s_type_map("type-map", llvm::cl::desc("JSON file mapping C++ builtins, classes and class templates to Jakt types, on top of the built-in mappings"),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<bool> s_depfiles("depfiles", llvm::cl::desc("Write a Make/Ninja depfile next to each binding, as <binding>.d, listing its header and every file the header includes"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<std::string> s_compdb_index("compdb-index", llvm::cl::desc("Index of the compilation database in the build path (-p), built on first use and whenever compile_commands.json changes. Loading it is much faster than parsing the JSON"),
+    llvm::cl::value_desc("file"),
+    llvm::cl::cat(s_tool_category));
+
+static llvm::cl::opt<bool> s_from_api_model("from-api-model", llvm::cl::desc("Treat the inputs as API models written by --emit-api-model, and generate their bindings without parsing any C++"),
+    llvm::cl::cat(s_tool_category));
+
+// Events shorter than this (in microseconds) are left out of the time trace. Same default as clang's -ftime-trace.
+static constexpr unsigned s_time_trace_granularity = 500;
+
+// Prints and writes out the statistics if they were requested, and returns the exit code to use.
+static int finishStatistics(int result)
+{
+    if (s_stats)
+        llvm::PrintStatistics(llvm::errs());
+
+    if (!s_stats_json.empty()) {
+        std::error_code ec;
+        llvm::raw_fd_ostream os(s_stats_json, ec, llvm::sys::fs::CD_CreateAlways);
+        if (ec) {
+            llvm::errs() << "Can't write statistics to " << s_stats_json << ": " << ec.message() << "\n";
+            return 1;
+        }
+        llvm::PrintStatisticsJSON(os);
+    }
+    return result;
+}
+
+// Writes the time trace out if one was requested, and returns the exit code to use.
+static int finishTimeTrace(int result)
+{
+    if (!llvm::timeTraceProfilerEnabled())
+        return result;
+
+    if (auto error = llvm::timeTraceProfilerWrite(s_time_trace, "jakt-bindgen")) {
+        llvm::errs() << "Can't write time trace to " << s_time_trace << ": " << llvm::toString(std::move(error)) << "\n";
+        result = 1;
+    }
+    llvm::timeTraceProfilerCleanup();
+    return result;
+}
 
 int main(int argc, char const** argv)
 {
     auto destination_path = std::filesystem::current_path();
 
-    auto expected_parser = clang::tooling::CommonOptionsParser::create(argc, argv, s_tool_category);
-    if (!expected_parser) {
-        // Fail gracefully for unsupported options.
-        llvm::errs() << expected_parser.takeError();
+    // Everything after "--" is the compile command of every header, in which case there's no compilation database to load.
+    std::string fixed_compilations_error;
+    auto fixed_compilations = clang::tooling::FixedCompilationDatabase::loadFromCommandLine(argc, argv, fixed_compilations_error);
+    llvm::cl::HideUnrelatedOptions(s_tool_category);
+    if (!llvm::cl::ParseCommandLineOptions(argc, argv, "", &llvm::errs())) {
+        llvm::errs() << fixed_compilations_error;
+        return 1;
+    }
+
+    if (!s_compdb_index.empty() && s_build_path.empty()) {
+        llvm::errs() << "--compdb-index needs the build path holding compile_commands.json (-p)\n";
+        return 1;
+    }
+
+    // Counters only start counting once enabled, so this has to happen before any work is done.
+    if (s_stats || !s_stats_json.empty())
+        llvm::EnableStatistics(/* DoPrintOnExit = */ false);
+
+    bool const time_trace = !s_time_trace.empty();
+    if (time_trace)
+        llvm::timeTraceProfilerInitialize(s_time_trace_granularity, "jakt-bindgen");
+
+    jakt_bindgen::BindingOptions options {
+        .target_namespace = s_target_namespace,
+        .out_dir = destination_path,
+        .jobs = s_jobs,
+        .cache_dir = s_cache_dir.getValue(),
+        .ast_cache_dir = s_ast_cache_dir.getValue(),
+        .precompiled_includes = { s_precompiled_includes.begin(), s_precompiled_includes.end() },
+        .umbrella = s_umbrella,
+        .emit_api_model = s_emit_api_model,
+        .symbol_index = s_symbol_index.getValue(),
+        .type_map = s_type_map.getValue(),
+        .write_depfiles = s_depfiles,
+        .report_memory = s_memory_report,
+        .report_file_system_cache = s_fs_cache_report,
+        .time_trace = time_trace,
+        .time_trace_granularity = s_time_trace_granularity,
+    };
+
+    std::vector<std::string> const listed_paths { s_source_paths.begin(), s_source_paths.end() };
+    if (s_from_api_model)
+        return finishTimeTrace(finishStatistics(jakt_bindgen::generateFromApiModels(listed_paths, options)));
+
+    auto base_dir = std::filesystem::canonical(s_base_path.c_str());
+    options.base_dir = base_dir;
+
+    jakt_bindgen::CompilationDatabaseOptions database_options {
+        .build_path = s_build_path,
+        // Without listed headers, --discover looks for compile_commands.json starting from the base directory.
+        .search_directory = s_discover ? base_dir.string() : std::string {},
+        .index_path = s_compdb_index,
+        .extra_args_before = { s_extra_args_before.begin(), s_extra_args_before.end() },
+        .extra_args = { s_extra_args.begin(), s_extra_args.end() },
+    };
+    std::unique_ptr<clang::tooling::CompilationDatabase> compilations;
+    if (fixed_compilations) {
+        compilations = jakt_bindgen::withExtraArguments(std::move(fixed_compilations), database_options);
+    } else {
+        std::string error_message;
+        compilations = jakt_bindgen::loadCompilationDatabase(database_options, listed_paths, error_message);
+        if (!compilations) {
+            llvm::errs() << "Error while trying to load a compilation database:\n"
+                         << error_message << "Running without flags.\n";
+            compilations = jakt_bindgen::withExtraArguments(std::make_unique<clang::tooling::FixedCompilationDatabase>(".", std::vector<std::string>()), database_options);
+        }
+    }
+
+    auto source_paths = listed_paths;
+    if (s_discover) {
+        jakt_bindgen::DiscoveryOptions discovery {
+            .base_dir = base_dir,
+            .target_namespace = s_target_namespace,
+            .include_globs = { s_include_globs.begin(), s_include_globs.end() },
+            .exclude_globs = { s_exclude_globs.begin(), s_exclude_globs.end() },
+        };
+        if (discovery.include_globs.empty())
+            discovery.include_globs.push_back("*.h");
+
+        auto discovered = jakt_bindgen::discoverSources(*compilations, discovery);
+        if (!discovered.has_value())
+            return 1;
+        source_paths.insert(source_paths.end(), discovered->begin(), discovered->end());
+    } else if (source_paths.empty()) {
+        llvm::errs() << "No headers given. List them, or pass --discover to find them under " << base_dir.string() << "\n";
         return 1;
     }
-    auto& options_parser = expected_parser.get();
-    clang::tooling::ClangTool tool(options_parser.getCompilations(), options_parser.getSourcePathList());
 
-    jakt_bindgen::SourceFileHandler handler(s_target_namespace, destination_path, std::filesystem::canonical(s_base_path.c_str()));
+    jakt_bindgen::ShardSpec shard;
+    if (!s_shard.empty()) {
+        auto parsed_shard = jakt_bindgen::ShardSpec::parse(s_shard);
+        if (!parsed_shard.has_value()) {
+            llvm::errs() << "Invalid shard " << s_shard << ", expected i/N with 0 <= i < N\n";
+            return 1;
+        }
+        shard = parsed_shard.value();
+        auto header_count = source_paths.size();
+        source_paths = jakt_bindgen::selectShard(source_paths, base_dir, shard);
+        llvm::outs() << "Shard " << shard.index << "/" << shard.count << ": " << source_paths.size() << " of " << header_count << " header(s)\n";
+    }
+
+    if (s_umbrella && !s_ast_cache_dir.empty())
+        llvm::errs() << "Umbrella translation units aren't snapshotted, ignoring --ast-cache\n";
+
+    jakt_bindgen::BindingRunner runner(*compilations, std::move(options));
+
+    if (s_watch)
+        return runner.watch(source_paths);
+
+    auto result = runner.run(source_paths);
+
+    if (!s_shard_manifest.empty() || !s_check_shards.empty()) {
+        auto manifest = jakt_bindgen::ShardManifest::create(shard, source_paths, base_dir, destination_path);
+        if (!s_shard_manifest.empty() && !manifest.write(s_shard_manifest))
+            result = 1;
+
+        if (!s_check_shards.empty()) {
+            std::vector<jakt_bindgen::ShardManifest> shards;
+            for (auto const& path : s_check_shards) {
+                auto shard_manifest = jakt_bindgen::ShardManifest::read(path);
+                if (!shard_manifest.has_value())
+                    return 1;
+                shards.push_back(std::move(shard_manifest.value()));
+            }
+            if (!jakt_bindgen::checkShardsMatchFullRun(manifest, shards))
+                result = 1;
+            else
+                llvm::outs() << "The " << shards.size() << " shard(s) match this run\n";
+        }
+    }
 
-    auto action = clang::tooling::newFrontendActionFactory(&handler.finder(), &handler);
+    if (s_memory_report)
+        llvm::outs() << "Peak resident set size: " << jakt_bindgen::peakResidentSetSize() / (1024 * 1024) << " MiB\n";
 
-    return tool.run(action.get());
+    return finishTimeTrace(finishStatistics(result));
 }